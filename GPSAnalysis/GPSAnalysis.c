@@ -7,18 +7,54 @@
  *              The program will read latitude, longitude, elevation and time of every point
  *              and produce general statistics during the whole track.
  *              Also, a form of splits (1 km) will be created.
- *              [Use built-in mktime() instead of self-made timeDiff().]
+ *              [Times are turned into seconds since the epoch (UTC) while parsing.]
+ *       Build: gcc -std=c99 -pthread -O2 -o GPSAnalysis GPSAnalysis.c -lm
+ *       Usage: GPSAnalysis [-i gpx] [-S] [-f] [-m manifest|directory] [-t threads] [-o output] [-c]
+ *                         [-s schemes]
+ *              -S streams the track: the statistics are worked out as the points are read,
+ *              so only the last point is kept and memory does not grow with the track.
+ *              The splits are printed as they are completed, before the overall statistics.
+ *              -f works out the distances between the stored points four at a time with
+ *              polynomial approximations instead of the math library; see fast_kernel()
+ *              for the error. The results may differ from the default in the last digits.
+ *              -m analyses many activities: the GPX files of a directory, or those listed
+ *              in a manifest (one path per line), on -t threads. Their overall statistics
+ *              and splits go to one CSV file (-o, "-" for stdout), one block of rows per
+ *              activity; split 0 is the whole activity. Files that cannot be read are
+ *              reported on stderr and skipped.
+ *              A single stored track of PARALLEL_POINTS points or more is also worked out on
+ *              -t threads, with exactly the same results as on one.
+ *              -c keeps the points of every GPX file in a binary file beside it, named with
+ *              CACHE_SUFFIX added, together with the distance of each point from the one
+ *              before and from the start. Later runs map that file instead of parsing the
+ *              GPX file, and rebuild it when the size or modification time of the GPX file
+ *              has changed. The cached distances are those of the default kernel.
+ *              -s adds splits of other lengths and laps of fixed time, e.g. -s 1km,1mi,400m,5min
+ *              (units m, km, mi, s, min and h; the number defaults to 1). They are all
+ *              worked out in the same pass as the 1 km splits, and unlike those their
+ *              boundaries fall exactly on the distance or time, interpolated between the
+ *              points around it. Each gets its own table, or its own rows with -m.
  */
 
-#define _XOPEN_SOURCE
-// Define it in order to use M_PI in math.h and strptime().
+#define _XOPEN_SOURCE 700
+// Define it in order to use M_PI in math.h, getopt(), getline() and the directory functions.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
-#include <time.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #define D2R (M_PI / 180.0)
+#define EARTH_RADIUS 6367137.0
 
 // Location of GPX file.
 //#define GPX_FILE_PATH "./inputFiles/Howth-Cross.gpx"
@@ -28,19 +64,167 @@
 //#define GPX_FILE_PATH "./inputFiles/Test2.gpx"
 //#define GPX_FILE_PATH "./inputFiles/Test3.gpx"
 
-// The node structure stores paths.
-struct node
+#define READ_BUFFER (1 << 20)
+// The file is read in blocks of this many bytes; no point may be longer.
+#define TAG_LOOKAHEAD 9
+// Enough to tell "</trkseg>" from the other tags.
+#define DIGITS2(str) (((str)[0] - '0') * 10 + (str)[1] - '0')
+#define DIGITS4(str) (DIGITS2(str) * 100 + DIGITS2((str) + 2))
+#define SPLIT_LENGTH 1000.0
+#define INITIAL_POINTS 1024
+#define OPTION_STRING "i:Sfm:t:o:cs:h"
+#define THREAD_NUM 4
+#define PARALLEL_POINTS 65536
+// The fewest points per thread for which a track is worked out in parallel.
+#define OUTPUT_FILE "-"
+// Where the rows of the batch mode go; "-" stands for stdout.
+#define GPX_SUFFIX ".gpx"
+// The files of a directory that the batch mode takes, in any case.
+#define INITIAL_FILES 256
+#define INITIAL_ROWS 4096
+#define INITIAL_SPLITS 64
+#define CACHE_SUFFIX ".trk"
+#define CACHE_MAGIC "GPSTRK1"
+// Changed whenever the layout of the cache or the parsing of the points changes.
+#define CACHE_BYTE_ORDER 0x01020304
+#define CACHE_ARRAYS 6
+// lat, lon, ele, t, dist and cum, each of eight bytes per point.
+#define BATCH_HEADER "file,scheme,split,distance_m,time_s,speed_kmh,elevation_m\n"
+// The scheme is empty for the whole activity and the 1 km splits.
+#define SCHEME_NAME 16
+#define MILE 1609.344
+#define INITIAL_LAPS 64
+#define FAST_ANGLE 0.01
+// The largest half difference of latitude or longitude (rad) the fast kernel takes; about 64 km.
+#define FAST_LANES 4
+#define PI_2_LOW 6.123233995736766e-17
+// pi/2 - (M_PI / 2.0), so that cosines near the poles keep their relative accuracy.
+
+#if defined(__GNUC__)
+#define FAST_KERNEL
+// GCC and Clang vector extensions; other compilers use the math library for -f as well.
+typedef double lanes __attribute__((vector_size(FAST_LANES * sizeof(double))));
+#if defined(__x86_64__) || defined(__i386__)
+#define FAST_KERNEL_AVX2
+// A second copy of the kernel for processors with AVX2, chosen at run time.
+#endif
+#endif
+
+// A way of cutting a track into splits, given with -s.
+struct split_scheme
+{
+	char name[SCHEME_NAME];
+	// As given, e.g. "1mi".
+	double step;
+	// The length of a split in metres, or of a lap in seconds.
+	_Bool byTime;
+};
+
+// Settings chosen on the command line. The macros above are the defaults.
+struct options
+{
+	const char *gpxFile;
+	_Bool streaming;
+	_Bool fast;
+	const char *manifest;
+	// The directory or list of GPX files for the batch mode, or NULL.
+	int threadNum;
+	const char *outputFile;
+	_Bool cache;
+	struct split_scheme *schemes;
+	int schemeNum;
+	// The schemes given with -s.
+};
+
+// One point of a track as the parser gives it.
+struct point
 {
 	double lat;
 	double lon;
 	double ele;
-	char timeString[22];
-	struct node *next;
+	long long t;
+	// Seconds since 1970-01-01T00:00:00Z.
+};
+
+/*
+ * The track structure stores paths as one array per field, so that a kernel going
+ * through the points reads each field in order. Point n is lat[n], lon[n], ele[n], t[n].
+ * A track read from a cache points into the mapped file instead, with the distances.
+ */
+struct track
+{
+	double *lat;
+	double *lon;
+	double *ele;
+	long long *t;
+	size_t num;
+	size_t cap;
+	// The arrays double in size when they are full.
+	double *dist;
+	double *cum;
+	// The distance of each point from the one before and from the start, or NULL.
+	void *map;
+	size_t mapLen;
+	// The mapped cache, or NULL.
+};
+
+/*
+ * The header of a cache, followed by the arrays lat, lon, ele, t, dist and cum of
+ * pointNum values each. The size and modification time are those of the GPX file.
+ */
+struct cache_header
+{
+	char magic[8];
+	uint32_t byteOrder;
+	uint32_t pad;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	int64_t sourceTimeNsec;
+	uint64_t pointNum;
+};
+
+// One split of a scheme. Its ends are interpolated, so the time is not a whole number of seconds.
+struct lap
+{
+	double length;
+	double duration;
+	double elevDiff;
+};
+
+// The splits of one scheme so far, and where the one in progress began.
+struct scheme_state
+{
+	const struct split_scheme *scheme;
+	long long boundaryNo;
+	// The boundaries passed; the next is at (boundaryNo + 1) * step.
+	double startDist;
+	double startTime;
+	double startEle;
+	struct lap *laps;
+	size_t lapNum;
+	size_t lapCap;
+};
+
+/*
+ * The split engine: every scheme of -s, advanced together one point at a time.
+ * Distances are measured from the first point along the track, times from its time.
+ */
+struct split_engine
+{
+	struct scheme_state *states;
+	int schemeNum;
+	_Bool started;
+	double dist;
+	double time;
+	double ele;
+	// At the last point.
+	double firstTime;
 };
 
 struct split
 {
 	int splitNo;
+	double length;
 	long int pace;
 	/*
 	 * time_t, equivalent to long int in gcc,
@@ -51,294 +235,1806 @@ struct split
 	struct split *next;
 };
 
-struct node *head = NULL;
-struct node *curr = NULL;
-struct split *headSplit = NULL;
-struct split *currSplit = NULL;
+/*
+ * The running totals of a track, updated one point at a time. Only the previous point
+ * and the split in progress are kept, whether the points come from the track or the file.
+ */
+struct track_stats
+{
+	int pointNum;
+	double pathLen;
+	double latPrev;
+	double lonPrev;
+	double cosLatPrev;
+	// Kept so that the cosine of every latitude is worked out once.
+	double elePrev;
+	long long timePrev;
+	long long startTime;
+	int splitNo;
+	double splitLen;
+	double startElevationSplit;
+	long long startTimeSplit;
+	_Bool splitOpen;
+	// Whether any distance has been added since the last split was completed.
+	_Bool printSplits;
+	// Print every split as soon as it is completed instead of keeping it in the list.
+	struct split *headSplit;
+	struct split *currSplit;
+	// The completed splits, unless they are printed.
+	struct split_engine *engine;
+	// The splits of -s, or NULL.
+};
+
+// The files of one thread of a batch. It takes them from the front and the others steal from the back.
+struct batch_queue
+{
+	size_t next;
+	size_t end;
+	pthread_mutex_t lock;
+};
+
+// The rows of an activity finished before those of an earlier file were written.
+struct batch_block
+{
+	char *rows;
+	size_t len;
+	_Bool done;
+};
+
+// The work shared by the threads of a batch.
+struct batch
+{
+	const struct options *opt;
+	char **files;
+	size_t fileNum;
+	struct batch_queue *queues;
+	int threadNum;
+	FILE *fp;
+	size_t failed;
+	struct batch_block *blocks;
+	size_t written;
+	// The files before this one have been written, so the rows come out in file order.
+	pthread_mutex_t lock;
+	// Guards fp, failed, blocks and written.
+};
+
+// One thread of a batch.
+struct batch_task
+{
+	struct batch *job;
+	int id;
+	pthread_t thread;
+};
+
+// One thread's share of a stored track in the parallel path of track_totals().
+struct track_task
+{
+	const struct track *tr;
+	_Bool fast;
+	double *dist;
+	double *cum;
+	// The distance from point 0, as a prefix sum of dist.
+	size_t begin;
+	size_t end;
+	// Its points [begin, end), or its splits in the last step.
+	double offset;
+	// The sum of dist over the points before begin.
+	const size_t *bounds;
+	// The point where each split starts, and the last point.
+	struct split *splits;
+	_Bool mismatch;
+	// Whether a split boundary found from cum was not where the serial sum puts it.
+	pthread_t thread;
+};
 
 // Function declaration.
-void open_file_and_load_data(void);
-double read_double_after_token(char *txtStr, char *tkn, char **endPtr);
-char *read_string_after_token(char *txtStr, char *tkn, char *res, int len);
-void add_to_list(double lat, double lon, double ele, char *timeStr);
-void create_list(double lat, double lon, double ele, char *timeStr);
-void calculate_tot_dist(void);
-double haversine_m(double lat1, double lon1, double lat2, double lon2);
-void add_to_splits_list(int splitNo, long int pace, double speed, double elevDiff);
-void create_splits(int splitNo, long int pace, double speed, double elevDiff);
+void parse_options(int argc, char *argv[], struct options *opt);
+int open_file_and_load_data(const struct options *opt, struct track *tr, struct track_stats *st);
+void stream_and_output(const struct options *opt);
+int batch_and_output(const struct options *opt);
+void *batch_worker(void *arg);
+void put_rows(struct batch *job, size_t file, const char *rows, size_t len);
+_Bool next_file(struct batch *job, int id, size_t *file);
+size_t list_files(const char *path, char ***files);
+void add_file(char ***files, size_t *num, size_t *cap, const char *dir, const char *name);
+int compare_files(const void *first, const void *second);
+void append_row(char **rows, size_t *len, size_t *cap, const char *format, ...);
+char *parse_point(char *str, struct point *pt);
+char *parse_number(char *str, double *value);
+char *parse_time(char *str, long long *t);
+long long days_from_civil(int year, int month, int day);
+void add_to_track(struct track *tr, const struct point *pt);
+void free_track(struct track *tr);
+int load_track(const struct options *opt, struct track *tr);
+char *cache_path(const char *gpxFile);
+_Bool map_cache(const char *path, const struct stat *source, struct track *tr);
+void write_cache(const char *path, const struct stat *source, struct track *tr);
+void calculate_tot_dist(const struct track *tr, const struct options *opt);
+void track_totals(const struct track *tr, struct track_stats *st, _Bool fast, int threadNum);
+_Bool parallel_totals(const struct track *tr, struct track_stats *st, _Bool fast, int threadNum);
+void run_tasks(struct track_task *tasks, int taskNum, void *(*job)(void *));
+void *distance_task(void *arg);
+void *offset_task(void *arg);
+void *split_task(void *arg);
+void begin_track(struct track_stats *st, _Bool printSplits);
+void add_point(struct track_stats *st, const struct point *pt);
+void add_segment(struct track_stats *st, const struct point *pt, double dist);
+void close_split(struct track_stats *st, double ele, long long t);
+void end_track(struct track_stats *st);
+void print_overall(struct track_stats *st);
+void print_splits_header(void);
+void print_split(int splitNo, long int pace, double speed, double elevDiff);
+void print_splits_footer(void);
+double haversine_m(double lat1, double lon1, double cosLat1, double lat2, double lon2, double cosLat2);
+void track_distances(const struct track *tr, size_t begin, size_t end, double *dist, _Bool fast);
+void fast_distances_generic(const struct track *tr, double *cosLat, double *dist);
+#ifdef FAST_KERNEL_AVX2
+void fast_distances_avx2(const struct track *tr, double *cosLat, double *dist);
+#endif
+void add_to_splits_list(struct track_stats *st, int splitNo, double length, long int pace, double speed,
+                        double elevDiff);
+void create_splits(struct track_stats *st, int splitNo, double length, long int pace, double speed,
+                   double elevDiff);
+void free_splits(struct track_stats *st);
+int parse_schemes(const char *spec, struct options *opt);
+void begin_schemes(struct split_engine *en, const struct options *opt);
+void scheme_point(struct split_engine *en, double dist, long long t, double ele);
+void add_lap(struct scheme_state *ss, double length, double duration, double elevDiff);
+void end_schemes(struct split_engine *en);
+void print_schemes(const struct split_engine *en);
+void free_schemes(struct split_engine *en);
 char *sec_to_clock_time(long int sec);
 
-int main(void)
+int main(int argc, char *argv[])
 {
-	open_file_and_load_data();
-	// Function that is called once at the start to read in the character names.
-	calculate_tot_dist();
-	return 0;
+	struct options opt;
+	struct track track = { NULL, NULL, NULL, NULL, 0, 0, NULL, NULL, NULL, 0 };
+	int status = EXIT_SUCCESS;
+	parse_options(argc, argv, &opt);
+	if ( opt.manifest )
+	{
+		status = batch_and_output(&opt);
+	}
+	else if ( opt.streaming )
+	{
+		stream_and_output(&opt);
+	}
+	else
+	{
+		if ( load_track(&opt, &track) != 0 )
+		// Function that is called once at the start to read in the track.
+		{
+			exit(EXIT_FAILURE);
+		}
+		calculate_tot_dist(&track, &opt);
+		free_track(&track);
+	}
+	free(opt.schemes);
+	return status;
+}
+
+/*
+ * Function: parse_options
+ * -----------------------
+ * Description: read the command line into opt, starting from the defaults.
+ * Parameters: argc, argv: the arguments of main();
+ *             opt: return the settings.
+ * Return: N/A.
+ */
+void parse_options(int argc, char *argv[], struct options *opt)
+{
+	int c;
+	opt -> gpxFile = GPX_FILE_PATH;
+	opt -> streaming = false;
+	opt -> fast = false;
+	opt -> manifest = NULL;
+	opt -> threadNum = THREAD_NUM;
+	opt -> outputFile = OUTPUT_FILE;
+	opt -> cache = false;
+	opt -> schemes = NULL;
+	opt -> schemeNum = 0;
+	while ( (c = getopt(argc, argv, OPTION_STRING)) != -1 )
+	{
+		switch ( c )
+		{
+			case 'i':
+				opt -> gpxFile = optarg;
+				break;
+			case 'S':
+				opt -> streaming = true;
+				break;
+			case 'f':
+				opt -> fast = true;
+				break;
+			case 'm':
+				opt -> manifest = optarg;
+				break;
+			case 'o':
+				opt -> outputFile = optarg;
+				break;
+			case 'c':
+				opt -> cache = true;
+				break;
+			case 's':
+				if ( parse_schemes(optarg, opt) != 0 )
+				{
+					fprintf(stderr, "%s: bad split scheme in \"%s\"\n", argv[0], optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 't':
+				opt -> threadNum = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-i gpx] [-S] [-f] [-m manifest|directory] [-t threads] [-o output] [-c] [-s schemes]\n",
+				        argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+	if ( opt -> threadNum < 1 )
+	{
+		fprintf(stderr, "%s: -t needs at least one thread\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	if ( (opt -> manifest || opt -> cache) && opt -> streaming )
+	{
+		fprintf(stderr, "%s: -m and -c cannot be used with -S\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
 }
 
 /*
  * Function: open_file_and_load_data
  * ---------------------------------
- * Description: open the designated file and parse the whole file.
- * Parameters: N/A.
- * Return: N/A.
+ * Description: open the designated file and parse the points of its first track segment.
+ *              The file is read in blocks of READ_BUFFER bytes and scanned for tags, so
+ *              points may be split over lines or share one. Every point is either stored
+ *              in the track or added to the running totals.
+ * Parameters: opt: the GPX file;
+ *             tr: the track to fill, or NULL in the streaming mode;
+ *             st: the running totals in the streaming mode, or NULL.
+ * Return: 0, or -1 if the file cannot be read or has no points, which is reported on stderr.
  */
-void open_file_and_load_data(void)
+int open_file_and_load_data(const struct options *opt, struct track *tr, struct track_stats *st)
 {
-	int lineNum = 0;
-	char theLine[120];
-	char *endOfHdr = "<trkseg>", *endOfData = "</trkseg>", *currPosition;
-	char tempTimeStr[30];
-	double lat, lon, ele;
-	FILE *fpn = fopen(GPX_FILE_PATH, "r"); // Open for reading.
+	int pointNum = 0;
+	size_t len = 0, got;
+	_Bool inSegment = false, endOfData = false, endOfFile = false;
+	char *buffer, *pos, *next, *end;
+	struct point pt = { 0.0, 0.0, 0.0, 0 };
+	FILE *fpn = fopen(opt -> gpxFile, "r"); // Open for reading.
 	if ( fpn == NULL ) // Check does file exist etc.
 	{
-		perror(GPX_FILE_PATH);
+		perror(opt -> gpxFile);
+		return -1;
+	}
+	buffer = malloc(READ_BUFFER + 1);
+	if ( buffer == NULL )
+	{
+		perror("buffer");
 		exit(EXIT_FAILURE);
 	}
-	else
+	while ( !endOfData && !endOfFile )
+	{
+		got = fread(buffer + len, 1, READ_BUFFER - len, fpn);
+		endOfFile = got < READ_BUFFER - len;
+		len += got;
+		end = buffer + len;
+		*end = '\0';
+		// The parsers stop at the sentinel, so they never need to check the length.
+		for ( pos = buffer; (pos = memchr(pos, '<', end - pos)) != NULL; )
+		{
+			if ( end - pos < TAG_LOOKAHEAD && !endOfFile )
+			// The tag may go on in the next block.
+			{
+				break;
+			}
+			if ( !inSegment )
+			// Skip through the header until "<trkseg>" is reached.
+			{
+				inSegment = strncmp(pos, "<trkseg>", 8) == 0;
+				pos++;
+				continue;
+			}
+			if ( strncmp(pos, "</trkseg>", 9) == 0 )
+			{
+				endOfData = true;
+				break;
+			}
+			if ( strncmp(pos, "<trkpt", 6) != 0 )
+			{
+				pos++;
+				continue;
+			}
+			next = parse_point(pos + 6, &pt);
+			if ( next > end )
+			// The point goes on in the next block.
+			{
+				break;
+			}
+			if ( st )
+			{
+				add_point(st, &pt);
+			}
+			else
+			{
+				add_to_track(tr, &pt);
+			}
+			pointNum++;
+			pos = next;
+		}
+		if ( pos == NULL )
+		{
+			len = 0;
+		}
+		else
+		{
+			len = end - pos;
+			if ( len == READ_BUFFER )
+			{
+				fprintf(stderr, "%s: a point longer than %d bytes\n", opt -> gpxFile, READ_BUFFER);
+				fclose(fpn);
+				free(buffer);
+				return -1;
+			}
+			memmove(buffer, pos, len);
+		}
+	}
+	free(buffer);
+	if ( ferror(fpn) )
+	{
+		perror(opt -> gpxFile);
+		fclose(fpn);
+		return -1;
+	}
+	fclose(fpn);
+	if ( pointNum == 0 )
+	{
+		fprintf(stderr, "%s: no track points\n", opt -> gpxFile);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Function: stream_and_output
+ * ---------------------------
+ * Description: the streaming mode. The points go straight from the file to the running
+ *              totals and are never stored, and every split is printed once it is completed.
+ *              The splits of -s are printed at the end.
+ * Parameter: opt: the GPX file.
+ * Return: N/A.
+ */
+void stream_and_output(const struct options *opt)
+{
+	struct track_stats st;
+	struct split_engine engine;
+	begin_track(&st, true);
+	if ( opt -> schemeNum )
+	{
+		begin_schemes(&engine, opt);
+		st.engine = &engine;
+	}
+	if ( open_file_and_load_data(opt, NULL, &st) != 0 )
+	{
+		exit(EXIT_FAILURE);
+	}
+	end_track(&st);
+	print_splits_footer();
+	print_overall(&st);
+	if ( st.engine )
+	{
+		print_schemes(&engine);
+		free_schemes(&engine);
+	}
+}
+
+/*
+ * Function: batch_and_output
+ * --------------------------
+ * Description: the batch mode. The files are shared out in equal runs among
+ *              opt -> threadNum threads; a thread that runs out steals the second half of
+ *              what is left to the busiest one, so a few long activities do not hold up
+ *              the rest. Each thread keeps its own track and running totals. The rows of
+ *              the activities are written in the order of the files, whatever the order
+ *              they are finished in, so the output does not depend on the threads.
+ * Parameter: opt: the settings, including the directory or manifest.
+ * Return: EXIT_SUCCESS, or EXIT_FAILURE if any file was skipped.
+ */
+int batch_and_output(const struct options *opt)
+{
+	int task;
+	size_t file;
+	struct batch_task *tasks;
+	struct batch job = { opt, NULL, 0, NULL, 0, NULL, 0, NULL, 0, PTHREAD_MUTEX_INITIALIZER };
+	job.fileNum = list_files(opt -> manifest, &job.files);
+	job.blocks = calloc(job.fileNum + 1, sizeof(struct batch_block));
+	if ( job.blocks == NULL )
+	{
+		perror("blocks");
+		exit(EXIT_FAILURE);
+	}
+	job.threadNum = (size_t) opt -> threadNum < job.fileNum ? opt -> threadNum : (int) job.fileNum;
+	job.fp = strcmp(opt -> outputFile, "-") ? fopen(opt -> outputFile, "w") : stdout;
+	if ( job.fp == NULL )
+	{
+		perror(opt -> outputFile);
+		exit(EXIT_FAILURE);
+	}
+	fputs(BATCH_HEADER, job.fp);
+	tasks = malloc(sizeof(struct batch_task) * (job.threadNum + 1));
+	job.queues = malloc(sizeof(struct batch_queue) * (job.threadNum + 1));
+	if ( tasks == NULL || job.queues == NULL )
+	{
+		perror("threads");
+		exit(EXIT_FAILURE);
+	}
+	for ( task = 0; task < job.threadNum; task++ )
+	{
+		job.queues[task].next = job.fileNum * task / job.threadNum;
+		job.queues[task].end = job.fileNum * (task + 1) / job.threadNum;
+		pthread_mutex_init(&job.queues[task].lock, NULL);
+	}
+	for ( task = 0; task < job.threadNum; task++ )
+	{
+		tasks[task].job = &job;
+		tasks[task].id = task;
+		if ( pthread_create(&tasks[task].thread, NULL, batch_worker, &tasks[task]) != 0 )
+		{
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for ( task = 0; task < job.threadNum; task++ )
+	{
+		pthread_join(tasks[task].thread, NULL);
+	}
+	for ( task = 0; task < job.threadNum; task++ )
+	{
+		pthread_mutex_destroy(&job.queues[task].lock);
+	}
+	pthread_mutex_destroy(&job.lock);
+	if ( (job.fp == stdout ? fflush(job.fp) : fclose(job.fp)) != 0 || (job.fp == stdout && ferror(job.fp)) )
+	{
+		perror(opt -> outputFile);
+		exit(EXIT_FAILURE);
+	}
+	if ( job.failed )
+	{
+		fprintf(stderr, "%zu of %zu files skipped\n", job.failed, job.fileNum);
+	}
+	for ( file = 0; file < job.fileNum; file++ )
+	{
+		free(job.files[file]);
+	}
+	free(job.files);
+	free(job.blocks);
+	free(job.queues);
+	free(tasks);
+	return job.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * Function: batch_worker
+ * ----------------------
+ * Description: the thread function of the batch mode. It analyses the files it gets from
+ *              next_file() until there are none left. The arrays of the track are kept
+ *              from one file to the next.
+ * Parameter: arg: the struct batch_task of the thread.
+ * Return: NULL.
+ */
+void *batch_worker(void *arg)
+{
+	struct batch_task *task = arg;
+	struct batch *job = task -> job;
+	struct options opt = *job -> opt;
+	struct track track = { NULL, NULL, NULL, NULL, 0, 0, NULL, NULL, NULL, 0 };
+	struct track_stats st;
+	struct split_engine engine;
+	struct split *ptrSplit;
+	struct scheme_state *ss;
+	size_t file, len, rowCap = INITIAL_ROWS, nameLen, quotedLen, quotedCap = INITIAL_ROWS, lap;
+	char *rows = malloc(rowCap), *quoted = malloc(quotedCap), *name;
+	if ( rows == NULL || quoted == NULL )
+	{
+		perror("rows");
+		exit(EXIT_FAILURE);
+	}
+	while ( next_file(job, task -> id, &file) )
+	{
+		opt.gpxFile = job -> files[file];
+		if ( track.map )
+		{
+			free_track(&track);
+		}
+		free(track.dist);
+		free(track.cum);
+		track.dist = track.cum = NULL;
+		track.num = 0;
+		// The arrays of the points are kept for the next file, unless they belong to a cache.
+		if ( load_track(&opt, &track) != 0 )
+		{
+			pthread_mutex_lock(&job -> lock);
+			job -> failed++;
+			pthread_mutex_unlock(&job -> lock);
+			put_rows(job, file, NULL, 0);
+			continue;
+		}
+		begin_track(&st, false);
+		if ( opt.schemeNum )
+		{
+			begin_schemes(&engine, &opt);
+			st.engine = &engine;
+		}
+		track_totals(&track, &st, opt.fast, 1);
+		// The activities are the unit of parallelism.
+		quotedLen = 0;
+		append_row(&quoted, &quotedLen, &quotedCap, "\"");
+		for ( name = job -> files[file]; *name; name += nameLen )
+		// The path is quoted, with any quote doubled.
+		{
+			nameLen = strcspn(name, "\"");
+			append_row(&quoted, &quotedLen, &quotedCap, "%.*s%s", (int) nameLen, name, name[nameLen] ? "\"\"" : "");
+			nameLen += name[nameLen] != '\0';
+		}
+		append_row(&quoted, &quotedLen, &quotedCap, "\"");
+		len = 0;
+		append_row(&rows, &len, &rowCap, "%s,,0,%.1f,%lld,%.2f,%.1f\n", quoted, st.pathLen,
+		           st.timePrev - st.startTime, st.pathLen * 3.6 / (double) (st.timePrev - st.startTime),
+		           st.elePrev - track.ele[0]);
+		for ( ptrSplit = st.headSplit; ptrSplit != NULL; ptrSplit = ptrSplit -> next )
+		{
+			append_row(&rows, &len, &rowCap, "%s,,%d,%.1f,%ld,%.2f,%.1f\n", quoted, ptrSplit -> splitNo,
+			           ptrSplit -> length, ptrSplit -> pace, ptrSplit -> speed, ptrSplit -> elevDiff);
+		}
+		free_splits(&st);
+		for ( ss = st.engine ? engine.states : NULL; ss && ss < engine.states + engine.schemeNum; ss++ )
+		{
+			for ( lap = 0; lap < ss -> lapNum; lap++ )
+			{
+				append_row(&rows, &len, &rowCap, "%s,%s,%zu,%.1f,%.1f,%.2f,%.1f\n", quoted, ss -> scheme -> name,
+				           lap + 1, ss -> laps[lap].length, ss -> laps[lap].duration,
+				           ss -> laps[lap].length * 3.6 / ss -> laps[lap].duration, ss -> laps[lap].elevDiff);
+			}
+		}
+		if ( st.engine )
+		{
+			free_schemes(&engine);
+		}
+		put_rows(job, file, rows, len);
+	}
+	free_track(&track);
+	free(rows);
+	free(quoted);
+	return NULL;
+}
+
+/*
+ * Function: put_rows
+ * ------------------
+ * Description: hand over the rows of a finished activity. They are written at once if
+ *              every earlier file has been, followed by any later blocks already waiting;
+ *              otherwise a copy waits in job -> blocks for its turn.
+ * Parameters: job: the batch;
+ *             file: the position of the file in job -> files;
+ *             rows, len: the rows, or NULL and 0 for a file which was skipped.
+ * Return: N/A.
+ */
+void put_rows(struct batch *job, size_t file, const char *rows, size_t len)
+{
+	struct batch_block *block;
+	pthread_mutex_lock(&job -> lock);
+	if ( file != job -> written )
+	{
+		block = &job -> blocks[file];
+		block -> rows = malloc(len + 1);
+		if ( block -> rows == NULL )
+		{
+			perror("rows");
+			exit(EXIT_FAILURE);
+		}
+		memcpy(block -> rows, rows ? rows : "", len);
+		block -> len = len;
+		block -> done = true;
+		pthread_mutex_unlock(&job -> lock);
+		return;
+	}
+	fwrite(rows ? rows : "", 1, len, job -> fp);
+	for ( job -> written++; job -> written < job -> fileNum && job -> blocks[job -> written].done; job -> written++ )
+	{
+		block = &job -> blocks[job -> written];
+		fwrite(block -> rows, 1, block -> len, job -> fp);
+		free(block -> rows);
+		block -> rows = NULL;
+	}
+	pthread_mutex_unlock(&job -> lock);
+}
+
+/*
+ * Function: next_file
+ * -------------------
+ * Description: take the next file of a thread from the front of its queue. When the
+ *              queue is empty, the back half of the longest other queue is moved to it.
+ * Parameters: job: the batch;
+ *             id: the thread;
+ *             file: return the position of the file in job -> files.
+ * Return: false when every queue is empty.
+ */
+_Bool next_file(struct batch *job, int id, size_t *file)
+{
+	struct batch_queue *own = &job -> queues[id], *victim;
+	size_t most, left, start;
+	int task, busiest;
+	pthread_mutex_lock(&own -> lock);
+	if ( own -> next < own -> end )
+	{
+		*file = own -> next++;
+		pthread_mutex_unlock(&own -> lock);
+		return true;
+	}
+	pthread_mutex_unlock(&own -> lock);
+	while ( true )
+	{
+		busiest = -1;
+		most = 0;
+		for ( task = 0; task < job -> threadNum; task++ )
+		{
+			pthread_mutex_lock(&job -> queues[task].lock);
+			left = job -> queues[task].end - job -> queues[task].next;
+			pthread_mutex_unlock(&job -> queues[task].lock);
+			if ( left > most )
+			{
+				most = left;
+				busiest = task;
+			}
+		}
+		if ( busiest < 0 )
+		{
+			return false;
+		}
+		victim = &job -> queues[busiest];
+		pthread_mutex_lock(&victim -> lock);
+		left = victim -> end - victim -> next;
+		start = victim -> end - (left + 1) / 2;
+		victim -> end = start;
+		pthread_mutex_unlock(&victim -> lock);
+		if ( left == 0 )
+		// Emptied by its owner or another thief in the meantime.
+		{
+			continue;
+		}
+		pthread_mutex_lock(&own -> lock);
+		own -> next = start + 1;
+		own -> end = start + (left + 1) / 2;
+		pthread_mutex_unlock(&own -> lock);
+		*file = start;
+		return true;
+	}
+}
+
+/*
+ * Function: list_files
+ * --------------------
+ * Description: list the files of the batch mode. A directory gives its files ending in
+ *              GPX_SUFFIX, in the order of their names; any other file is a manifest
+ *              with one path per line, where blank lines and lines starting with '#' are
+ *              skipped.
+ * Parameters: path: the directory or manifest;
+ *             files: return the paths.
+ * Return: the number of files.
+ */
+size_t list_files(const char *path, char ***files)
+{
+	struct stat info;
+	DIR *dir;
+	struct dirent *entry;
+	FILE *fp;
+	size_t num = 0, cap = 0, bufSize = 0, len, suffixLen = strlen(GPX_SUFFIX), pos;
+	char *userinput = NULL, *line;
+	*files = NULL;
+	if ( stat(path, &info) != 0 )
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	if ( S_ISDIR(info.st_mode) )
+	{
+		if ( (dir = opendir(path)) == NULL )
+		{
+			perror(path);
+			exit(EXIT_FAILURE);
+		}
+		while ( (entry = readdir(dir)) != NULL )
+		{
+			len = strlen(entry -> d_name);
+			for ( pos = 0; pos < suffixLen && len > suffixLen; pos++ )
+			{
+				if ( tolower((unsigned char) entry -> d_name[len - suffixLen + pos]) != GPX_SUFFIX[pos] )
+				{
+					break;
+				}
+			}
+			if ( len > suffixLen && pos == suffixLen )
+			{
+				add_file(files, &num, &cap, path, entry -> d_name);
+			}
+		}
+		closedir(dir);
+		qsort(*files, num, sizeof(char *), compare_files);
+		return num;
+	}
+	if ( (fp = fopen(path, "r")) == NULL )
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	while ( getline(&userinput, &bufSize, fp) != -1 )
+	{
+		for ( line = userinput; isspace((unsigned char) *line); line++ )
+		{
+			;
+		}
+		for ( len = strlen(line); len > 0 && isspace((unsigned char) line[len - 1]); len-- )
+		{
+			;
+		}
+		line[len] = '\0';
+		if ( *line != '\0' && *line != '#' )
+		{
+			add_file(files, &num, &cap, NULL, line);
+		}
+	}
+	if ( ferror(fp) )
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	fclose(fp);
+	free(userinput);
+	return num;
+}
+
+/*
+ * Function: add_file
+ * ------------------
+ * Description: append a copy of a path to the list of files, growing it when it is full.
+ * Parameters: files, num, cap: the list, its length and its capacity;
+ *             dir: the directory of the file, or NULL if name is the whole path;
+ *             name: the file.
+ * Return: N/A.
+ */
+void add_file(char ***files, size_t *num, size_t *cap, const char *dir, const char *name)
+{
+	size_t dirLen = dir ? strlen(dir) : 0;
+	if ( *num == *cap )
+	{
+		*cap = *cap ? *cap * 2 : INITIAL_FILES;
+		*files = realloc(*files, sizeof(char *) * *cap);
+		if ( *files == NULL )
+		{
+			perror("files");
+			exit(EXIT_FAILURE);
+		}
+	}
+	(*files)[*num] = malloc(dirLen + strlen(name) + 2);
+	if ( (*files)[*num] == NULL )
+	{
+		perror("files");
+		exit(EXIT_FAILURE);
+	}
+	if ( dir )
+	{
+		sprintf((*files)[*num], dirLen && dir[dirLen - 1] == '/' ? "%s%s" : "%s/%s", dir, name);
+	}
+	else
+	{
+		strcpy((*files)[*num], name);
+	}
+	(*num)++;
+}
+
+/*
+ * Function: compare_files
+ * -----------------------
+ * Description: the order of the files of a directory, for qsort().
+ * Parameters: first, second: pointers to two paths.
+ * Return: as strcmp().
+ */
+int compare_files(const void *first, const void *second)
+{
+	return strcmp(*(char * const *) first, *(char * const *) second);
+}
+
+/*
+ * Function: append_row
+ * --------------------
+ * Description: append formatted text to the rows of an activity, growing them as needed.
+ * Parameters: rows, len, cap: the text, its length and its capacity;
+ *             format, ...: as printf().
+ * Return: N/A.
+ */
+void append_row(char **rows, size_t *len, size_t *cap, const char *format, ...)
+{
+	va_list args;
+	int written;
+	while ( true )
+	{
+		va_start(args, format);
+		written = vsnprintf(*rows + *len, *cap - *len, format, args);
+		va_end(args);
+		if ( written < 0 )
+		{
+			perror("rows");
+			exit(EXIT_FAILURE);
+		}
+		if ( (size_t) written < *cap - *len )
+		{
+			*len += written;
+			return;
+		}
+		*cap *= 2;
+		*rows = realloc(*rows, *cap);
+		if ( *rows == NULL )
+		{
+			perror("rows");
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/*
+ * Function: parse_point
+ * ---------------------
+ * Description: parse one point, e.g.
+ *              <trkpt lat="53.308055000" lon="-6.228524000"><ele>24.4</ele><time>...</time></trkpt>
+ *              in a single pass. Other attributes and elements are skipped. A point
+ *              without <ele> is at elevation 0 and one without <time> keeps the time
+ *              already in pt, i.e. that of the point before.
+ * Parameters: str: the text just after "<trkpt", ending with '\0';
+ *             pt: return the point.
+ * Return: the address just after "</trkpt>" (or "/>"), or one past the '\0'
+ *         if the point is not complete.
+ */
+char *parse_point(char *str, struct point *pt)
+{
+	char quote, *next;
+	pt -> ele = 0.0;
+	while ( *str != '>' )
+	// The attributes.
+	{
+		if ( *str == '\0' )
+		{
+			return str + 1;
+		}
+		if ( str[0] == '/' && str[1] == '>' )
+		{
+			return str + 2;
+		}
+		if ( isspace((unsigned char) str[-1]) && str[0] == 'l'
+		     && ((str[1] == 'a' && str[2] == 't') || (str[1] == 'o' && str[2] == 'n')) && str[3] == '=' )
+		{
+			quote = str[4];
+			str = parse_number(str + 5, str[1] == 'a' ? &pt -> lat : &pt -> lon);
+			while ( *str != quote && *str != '\0' )
+			{
+				str++;
+			}
+			continue;
+		}
+		str++;
+	}
+	while ( true )
+	// The elements.
+	{
+		if ( (next = strchr(str, '<')) == NULL )
+		{
+			return str + strlen(str) + 1;
+		}
+		str = next;
+		if ( strncmp(str, "<ele>", 5) == 0 )
+		{
+			str = parse_number(str + 5, &pt -> ele);
+		}
+		else if ( strncmp(str, "<time>", 6) == 0 )
+		{
+			str = parse_time(str + 6, &pt -> t);
+		}
+		else if ( strncmp(str, "</trkpt>", 8) == 0 )
+		{
+			return str + 8;
+		}
+		else
+		{
+			str++;
+		}
+	}
+}
+
+/*
+ * Function: parse_number
+ * ----------------------
+ * Description: read a decimal number. Up to 19 significant digits and a power of ten
+ *              up to 22 are turned into a double with one multiplication or division
+ *              of exact values, which rounds exactly as strtod() does; anything else
+ *              is left to strtod().
+ * Parameters: str: the text of the number;
+ *             value: return the number, or 0.0 if there is none.
+ * Return: the address of the next character after the number.
+ */
+char *parse_number(char *str, double *value)
+{
+	static const double powerOfTen[23] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	                                       1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+	                                       1e20, 1e21, 1e22 };
+	char *start = str;
+	uint64_t mantissa = 0;
+	int digitNum = 0, scale = 0;
+	_Bool negative = false;
+	if ( *str == '-' || *str == '+' )
+	{
+		negative = *str++ == '-';
+	}
+	for ( ; *str >= '0' && *str <= '9'; str++, digitNum++ )
+	{
+		mantissa = mantissa * 10 + (*str - '0');
+	}
+	if ( *str == '.' )
+	{
+		for ( str++; *str >= '0' && *str <= '9'; str++, digitNum++, scale++ )
+		{
+			mantissa = mantissa * 10 + (*str - '0');
+		}
+	}
+	if ( digitNum > 19 || mantissa > ((uint64_t) 1 << 53) || scale > 22 || *str == 'e' || *str == 'E' )
+	{
+		*value = strtod(start, &str);
+		return str;
+	}
+	*value = (double) mantissa / powerOfTen[scale];
+	if ( negative )
+	{
+		*value = -*value;
+	}
+	return str;
+}
+
+/*
+ * Function: parse_time
+ * --------------------
+ * Description: turn an ISO 8601 time such as "2013-09-12T15:59:18Z" into seconds
+ *              since the epoch with integer arithmetic only. Fractions of a second are
+ *              dropped and an offset such as "+01:00" is taken away to give UTC.
+ * Parameters: str: the text of the time;
+ *             t: return the time; it is left alone if the text is not such a time.
+ * Return: the address of the next character after the time.
+ */
+char *parse_time(char *str, long long *t)
+{
+	int pos, offset;
+	long long sec;
+	for ( pos = 0; pos < 19; pos++ )
+	// Digits everywhere except the separators of "YYYY-MM-DDTHH:MM:SS".
+	{
+		if ( pos == 4 || pos == 7 ? str[pos] != '-' : pos == 10 ? str[pos] != 'T'
+		     : pos == 13 || pos == 16 ? str[pos] != ':' : str[pos] < '0' || str[pos] > '9' )
+		{
+			return str;
+		}
+	}
+	sec = days_from_civil(DIGITS4(str), DIGITS2(str + 5), DIGITS2(str + 8)) * 86400LL
+	      + DIGITS2(str + 11) * 3600 + DIGITS2(str + 14) * 60 + DIGITS2(str + 17);
+	for ( str += 19; *str == '.' || (*str >= '0' && *str <= '9'); str++ )
+	{
+		;
+	}
+	if ( (*str == '+' || *str == '-') && str[1] >= '0' && str[1] <= '9' && str[2] >= '0' && str[2] <= '9' )
+	{
+		offset = DIGITS2(str + 1) * 3600;
+		if ( str[3] == ':' && str[4] >= '0' && str[4] <= '9' && str[5] >= '0' && str[5] <= '9' )
+		{
+			offset += DIGITS2(str + 4) * 60;
+		}
+		sec += *str == '+' ? -offset : offset;
+	}
+	*t = sec;
+	return str;
+}
+
+/*
+ * Function: days_from_civil
+ * -------------------------
+ * Description: count the days from 1970-01-01 to a date of the proleptic Gregorian calendar.
+ * Parameters: year, month, day: the date.
+ * Return: the number of days, negative before 1970.
+ */
+long long days_from_civil(int year, int month, int day)
+{
+	int era, yearOfEra, dayOfYear, dayOfEra;
+	year -= month <= 2;
+	// Count years from March, so that the leap day is the last day of the year.
+	era = (year >= 0 ? year : year - 399) / 400;
+	yearOfEra = year - era * 400;
+	dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	return era * 146097LL + dayOfEra - 719468;
+}
+
+/*
+ * Function: add_to_track
+ * ----------------------
+ * Description: append a point to the track, growing the arrays when they are full.
+ * Parameters: tr: the track;
+ *             pt: the point.
+ * Return: N/A.
+ */
+void add_to_track(struct track *tr, const struct point *pt)
+{
+	size_t cap;
+	if ( tr -> num == tr -> cap )
+	{
+		cap = tr -> cap ? tr -> cap * 2 : INITIAL_POINTS;
+		tr -> lat = realloc(tr -> lat, sizeof(double) * cap);
+		tr -> lon = realloc(tr -> lon, sizeof(double) * cap);
+		tr -> ele = realloc(tr -> ele, sizeof(double) * cap);
+		tr -> t = realloc(tr -> t, sizeof(long long) * cap);
+		if ( tr -> lat == NULL || tr -> lon == NULL || tr -> ele == NULL || tr -> t == NULL )
+		{
+			perror("Track growth failed");
+			exit(EXIT_FAILURE);
+		}
+		tr -> cap = cap;
+	}
+	tr -> lat[tr -> num] = pt -> lat;
+	tr -> lon[tr -> num] = pt -> lon;
+	tr -> ele[tr -> num] = pt -> ele;
+	tr -> t[tr -> num] = pt -> t;
+	tr -> num++;
+}
+
+/*
+ * Function: free_track
+ * --------------------
+ * Description: release the arrays of a track, or unmap its cache, and leave it empty.
+ * Parameter: tr: the track.
+ * Return: N/A.
+ */
+void free_track(struct track *tr)
+{
+	if ( tr -> map )
+	{
+		munmap(tr -> map, tr -> mapLen);
+	}
+	else
+	{
+		free(tr -> lat);
+		free(tr -> lon);
+		free(tr -> ele);
+		free(tr -> t);
+		free(tr -> dist);
+		free(tr -> cum);
+	}
+	tr -> lat = tr -> lon = tr -> ele = tr -> dist = tr -> cum = NULL;
+	tr -> t = NULL;
+	tr -> map = NULL;
+	tr -> num = tr -> cap = tr -> mapLen = 0;
+}
+
+/*
+ * Function: load_track
+ * --------------------
+ * Description: read the track of a GPX file into an empty track. With opt -> cache the
+ *              cache beside the file is mapped if it is up to date, and otherwise the
+ *              file is parsed and the cache written for the next run.
+ * Parameters: opt: the GPX file and whether to use a cache;
+ *             tr: return the track.
+ * Return: 0, or -1 if the file cannot be read or has no points, which is reported on stderr.
+ */
+int load_track(const struct options *opt, struct track *tr)
+{
+	struct stat source;
+	char *path;
+	int result;
+	if ( !opt -> cache )
+	{
+		return open_file_and_load_data(opt, tr, NULL);
+	}
+	if ( stat(opt -> gpxFile, &source) != 0 )
+	{
+		perror(opt -> gpxFile);
+		return -1;
+	}
+	path = cache_path(opt -> gpxFile);
+	result = 0;
+	if ( !map_cache(path, &source, tr) )
+	{
+		result = open_file_and_load_data(opt, tr, NULL);
+		if ( result == 0 )
+		{
+			write_cache(path, &source, tr);
+		}
+	}
+	free(path);
+	return result;
+}
+
+/*
+ * Function: cache_path
+ * --------------------
+ * Description: name the cache of a GPX file.
+ * Parameter: gpxFile: the GPX file.
+ * Return: the path, which the caller frees.
+ */
+char *cache_path(const char *gpxFile)
+{
+	char *path = malloc(strlen(gpxFile) + sizeof(CACHE_SUFFIX));
+	if ( path == NULL )
+	{
+		perror("cache_path");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(path, gpxFile);
+	strcat(path, CACHE_SUFFIX);
+	return path;
+}
+
+/*
+ * Function: map_cache
+ * -------------------
+ * Description: map a cache and point the track into it, if it was written by this version
+ *              with this byte order from a GPX file of the same size and modification time.
+ * Parameters: path: the cache;
+ *             source: the status of the GPX file;
+ *             tr: return the track, replacing any arrays it had.
+ * Return: true, or false if there is no such cache.
+ */
+_Bool map_cache(const char *path, const struct stat *source, struct track *tr)
+{
+	struct stat info;
+	struct cache_header *header;
+	void *map;
+	size_t num;
+	int fd = open(path, O_RDONLY);
+	if ( fd < 0 )
+	{
+		return false;
+	}
+	if ( fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(struct cache_header)
+	     || (map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED )
+	{
+		close(fd);
+		return false;
+	}
+	close(fd);
+	// The mapping stays valid without the descriptor.
+	header = map;
+	num = header -> pointNum;
+	if ( memcmp(header -> magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header -> byteOrder != CACHE_BYTE_ORDER
+	     || header -> sourceSize != (uint64_t) source -> st_size
+	     || header -> sourceTime != (int64_t) source -> st_mtim.tv_sec
+	     || header -> sourceTimeNsec != (int64_t) source -> st_mtim.tv_nsec || num == 0
+	     || num > ((size_t) info.st_size - sizeof(struct cache_header)) / (CACHE_ARRAYS * sizeof(double))
+	     || (size_t) info.st_size != sizeof(struct cache_header) + num * CACHE_ARRAYS * sizeof(double) )
+	{
+		munmap(map, info.st_size);
+		return false;
+	}
+	free_track(tr);
+	// Any arrays of its own are not needed.
+	tr -> lat = (double *) (header + 1);
+	tr -> lon = tr -> lat + num;
+	tr -> ele = tr -> lon + num;
+	tr -> t = (long long *) (tr -> ele + num);
+	tr -> dist = (double *) (tr -> t + num);
+	tr -> cum = tr -> dist + num;
+	tr -> num = tr -> cap = num;
+	tr -> map = map;
+	tr -> mapLen = info.st_size;
+	return true;
+}
+
+/*
+ * Function: write_cache
+ * ---------------------
+ * Description: work out the distances of a parsed track, keeping them in it, and write
+ *              the cache. It is written to a temporary file which then replaces the cache,
+ *              so that a reader never sees half of one. A failure is reported on stderr
+ *              and leaves the old cache, if any, which no longer matches.
+ * Parameters: path: the cache;
+ *             source: the status of the GPX file, taken before it was parsed;
+ *             tr: the track.
+ * Return: N/A.
+ */
+void write_cache(const char *path, const struct stat *source, struct track *tr)
+{
+	struct cache_header header;
+	size_t num;
+	int fd;
+	FILE *fp;
+	char *temp = malloc(strlen(path) + sizeof(".XXXXXX"));
+	tr -> dist = malloc(sizeof(double) * tr -> num);
+	tr -> cum = malloc(sizeof(double) * tr -> num);
+	if ( temp == NULL || tr -> dist == NULL || tr -> cum == NULL )
+	{
+		perror("write_cache");
+		exit(EXIT_FAILURE);
+	}
+	track_distances(tr, 0, tr -> num, tr -> dist, false);
+	tr -> cum[0] = 0.0;
+	for ( num = 1; num < tr -> num; num++ )
+	{
+		tr -> cum[num] = tr -> cum[num - 1] + tr -> dist[num];
+		// The running sum of the serial path, so cum[num - 1] is the path length.
+	}
+	memset(&header, 0, sizeof(struct cache_header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.byteOrder = CACHE_BYTE_ORDER;
+	header.sourceSize = source -> st_size;
+	header.sourceTime = source -> st_mtim.tv_sec;
+	header.sourceTimeNsec = source -> st_mtim.tv_nsec;
+	header.pointNum = tr -> num;
+	strcpy(temp, path);
+	strcat(temp, ".XXXXXX");
+	if ( (fd = mkstemp(temp)) < 0 )
+	{
+		perror(temp);
+		free(temp);
+		return;
+	}
+	fchmod(fd, source -> st_mode & 0666);
+	// As readable as the GPX file rather than only by its owner.
+	if ( (fp = fdopen(fd, "wb")) == NULL )
+	{
+		perror(temp);
+		close(fd);
+		unlink(temp);
+		free(temp);
+		return;
+	}
+	fwrite(&header, sizeof(struct cache_header), 1, fp);
+	fwrite(tr -> lat, sizeof(double), tr -> num, fp);
+	fwrite(tr -> lon, sizeof(double), tr -> num, fp);
+	fwrite(tr -> ele, sizeof(double), tr -> num, fp);
+	fwrite(tr -> t, sizeof(long long), tr -> num, fp);
+	fwrite(tr -> dist, sizeof(double), tr -> num, fp);
+	fwrite(tr -> cum, sizeof(double), tr -> num, fp);
+	if ( ferror(fp) | fclose(fp) || rename(temp, path) != 0 )
+	{
+		perror(path);
+		unlink(temp);
+	}
+	free(temp);
+}
+
+/*
+ * Function: calculate_tot_dist
+ * ----------------------------
+ * Description: calculate the total length of the track and print out the statistics.
+ * Parameters: tr: the track;
+ *             opt: whether to use the fast kernel.
+ * Return: N/A.
+ */
+void calculate_tot_dist(const struct track *tr, const struct options *opt)
+{
+	struct track_stats st;
+	struct split_engine engine;
+	struct split *ptrSplit;
+	begin_track(&st, false);
+	if ( opt -> schemeNum )
+	{
+		begin_schemes(&engine, opt);
+		st.engine = &engine;
+	}
+	track_totals(tr, &st, opt -> fast, opt -> threadNum);
+	// Print results on the screen.
+	print_overall(&st);
+	print_splits_header();
+	for ( ptrSplit = st.headSplit; ptrSplit != NULL; ptrSplit = ptrSplit -> next )
+	{
+		print_split(ptrSplit -> splitNo, ptrSplit -> pace, ptrSplit -> speed, ptrSplit -> elevDiff);
+	}
+	print_splits_footer();
+	free_splits(&st);
+	if ( st.engine )
+	{
+		print_schemes(&engine);
+		free_schemes(&engine);
+	}
+}
+
+/*
+ * Function: track_totals
+ * ----------------------
+ * Description: add a whole stored track to the running totals and complete the last split.
+ *              The distances between the points are worked out first, in one pass, unless
+ *              they come from a cache. Otherwise a long track is left to parallel_totals()
+ *              if there is more than one thread.
+ * Parameters: tr: the track;
+ *             st: the running totals, just begun;
+ *             fast: use the fast kernel;
+ *             threadNum: the most threads to use.
+ * Return: N/A.
+ */
+void track_totals(const struct track *tr, struct track_stats *st, _Bool fast, int threadNum)
+{
+	size_t num;
+	struct point pt;
+	double *dist = tr -> dist;
+	if ( dist == NULL && tr -> num / PARALLEL_POINTS >= 2 && threadNum > 1
+	     && parallel_totals(tr, st, fast, tr -> num / PARALLEL_POINTS < (size_t) threadNum
+	                                      ? (int) (tr -> num / PARALLEL_POINTS) : threadNum) )
+	{
+		return;
+	}
+	if ( dist == NULL )
+	// Not known from a cache.
+	{
+		dist = malloc(sizeof(double) * (tr -> num + 1));
+		if ( dist == NULL )
+		{
+			perror("dist");
+			exit(EXIT_FAILURE);
+		}
+		track_distances(tr, 0, tr -> num, dist, fast);
+	}
+	for ( num = 0; num < tr -> num; num++ )
+	{
+		pt.lat = tr -> lat[num];
+		pt.lon = tr -> lon[num];
+		pt.ele = tr -> ele[num];
+		pt.t = tr -> t[num];
+		add_segment(st, &pt, dist[num]);
+	}
+	end_track(st);
+	if ( dist != tr -> dist )
+	{
+		free(dist);
+	}
+}
+
+/*
+ * Function: parallel_totals
+ * -------------------------
+ * Description: the parallel path of track_totals(), in three steps on threadNum threads:
+ *              1. each thread works out the distances of its run of points and their
+ *                 prefix sum, and the runs are then offset by the totals of those before;
+ *              2. the split boundaries are found by binary search in the prefix sums,
+ *                 as the first point at least SPLIT_LENGTH beyond the start of the split;
+ *              3. the threads share the splits and add up the distance of each in order,
+ *                 as the serial path does, which also checks its boundary.
+ *              A prefix sum is rounded differently from the serial sum, so a boundary
+ *              within rounding of SPLIT_LENGTH may be off by a point; the check finds it
+ *              and the caller then takes the serial path. The path length is added up in
+ *              order too, one addition per point, so every result is the serial one.
+ * Parameters: tr: the track, with at least two points;
+ *             st: the running totals, just begun;
+ *             fast: use the fast kernel;
+ *             threadNum: the number of threads.
+ * Return: true, or false (with st untouched) if the caller must take the serial path.
+ */
+_Bool parallel_totals(const struct track *tr, struct track_stats *st, _Bool fast, int threadNum)
+{
+	size_t num, low, high, mid, splitNum = 0, boundCap = INITIAL_SPLITS, *bounds = malloc(sizeof(size_t) * boundCap);
+	int task;
+	double target, offset = 0.0;
+	_Bool mismatch = false;
+	double *dist = malloc(sizeof(double) * tr -> num * 2);
+	struct track_task *tasks = malloc(sizeof(struct track_task) * threadNum);
+	struct split *splits;
+	if ( bounds == NULL || dist == NULL || tasks == NULL )
+	{
+		perror("parallel_totals");
+		exit(EXIT_FAILURE);
+	}
+	for ( task = 0; task < threadNum; task++ )
+	{
+		tasks[task].tr = tr;
+		tasks[task].fast = fast;
+		tasks[task].dist = dist;
+		tasks[task].cum = dist + tr -> num;
+		tasks[task].begin = tr -> num * task / threadNum;
+		tasks[task].end = tr -> num * (task + 1) / threadNum;
+		tasks[task].bounds = bounds;
+		tasks[task].mismatch = false;
+	}
+	run_tasks(tasks, threadNum, distance_task);
+	for ( task = 0; task < threadNum; task++ )
+	{
+		tasks[task].offset = offset;
+		offset += tasks[task].cum[tasks[task].end - 1];
+	}
+	if ( !isfinite(offset) )
+	// The prefix sums cannot be searched.
+	{
+		free(bounds);
+		free(dist);
+		free(tasks);
+		return false;
+	}
+	run_tasks(tasks + 1, threadNum - 1, offset_task);
+	bounds[0] = 0;
+	while ( bounds[splitNum] < tr -> num - 1 )
+	// The first point of each split, then the last point.
+	{
+		target = tasks[0].cum[bounds[splitNum]] + SPLIT_LENGTH;
+		for ( low = bounds[splitNum] + 1, high = tr -> num - 1; low < high; )
+		{
+			mid = low + (high - low) / 2;
+			if ( tasks[0].cum[mid] >= target )
+			{
+				high = mid;
+			}
+			else
+			{
+				low = mid + 1;
+			}
+		}
+		if ( ++splitNum == boundCap )
+		{
+			boundCap *= 2;
+			bounds = realloc(bounds, sizeof(size_t) * boundCap);
+			if ( bounds == NULL )
+			{
+				perror("bounds");
+				exit(EXIT_FAILURE);
+			}
+		}
+		bounds[splitNum] = low;
+	}
+	splits = malloc(sizeof(struct split) * (splitNum + 1));
+	if ( splits == NULL )
+	{
+		perror("splits");
+		exit(EXIT_FAILURE);
+	}
+	for ( task = 0; task < threadNum; task++ )
+	{
+		tasks[task].bounds = bounds;
+		tasks[task].splits = splits;
+		tasks[task].begin = splitNum * task / threadNum;
+		tasks[task].end = splitNum * (task + 1) / threadNum;
+	}
+	run_tasks(tasks, threadNum, split_task);
+	for ( task = 0; task < threadNum; task++ )
+	{
+		mismatch |= tasks[task].mismatch;
+	}
+	if ( !mismatch )
+	{
+		for ( num = 1; num < tr -> num; num++ )
+		{
+			st -> pathLen += dist[num];
+		}
+		for ( num = 0; num < splitNum; num++ )
+		{
+			add_to_splits_list(st, splits[num].splitNo, splits[num].length, splits[num].pace,
+			                   splits[num].speed, splits[num].elevDiff);
+		}
+		st -> pointNum = (int) tr -> num;
+		st -> startTime = tr -> t[0];
+		st -> splitNo = (int) splitNum;
+		st -> startElevationSplit = tr -> ele[tr -> num - 1];
+		st -> startTimeSplit = tr -> t[tr -> num - 1];
+		st -> latPrev = tr -> lat[tr -> num - 1];
+		st -> lonPrev = tr -> lon[tr -> num - 1];
+		st -> elePrev = tr -> ele[tr -> num - 1];
+		st -> timePrev = tr -> t[tr -> num - 1];
+		// As the serial path leaves them, with every split completed.
+		if ( st -> engine )
+		{
+			for ( num = 0; num < tr -> num; num++ )
+			{
+				scheme_point(st -> engine, dist[num], tr -> t[num], tr -> ele[num]);
+			}
+			end_schemes(st -> engine);
+		}
+	}
+	free(splits);
+	free(bounds);
+	free(dist);
+	free(tasks);
+	return !mismatch;
+}
+
+/*
+ * Function: run_tasks
+ * -------------------
+ * Description: run a function on every task, each in its own thread, and wait for them.
+ * Parameters: tasks: the tasks;
+ *             taskNum: the number of tasks;
+ *             job: the thread function, given a struct track_task.
+ * Return: N/A.
+ */
+void run_tasks(struct track_task *tasks, int taskNum, void *(*job)(void *))
+{
+	int task;
+	for ( task = 0; task < taskNum; task++ )
+	{
+		if ( pthread_create(&tasks[task].thread, NULL, job, &tasks[task]) != 0 )
+		{
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for ( task = 0; task < taskNum; task++ )
+	{
+		pthread_join(tasks[task].thread, NULL);
+	}
+}
+
+/*
+ * Function: distance_task
+ * -----------------------
+ * Description: work out the distances of a run of points and their sum from the start
+ *              of the run.
+ * Parameter: arg: the struct track_task.
+ * Return: NULL.
+ */
+void *distance_task(void *arg)
+{
+	struct track_task *task = arg;
+	size_t num;
+	double sum = 0.0;
+	track_distances(task -> tr, task -> begin, task -> end, task -> dist, task -> fast);
+	for ( num = task -> begin; num < task -> end; num++ )
+	{
+		sum += task -> dist[num];
+		task -> cum[num] = sum;
+	}
+	return NULL;
+}
+
+/*
+ * Function: offset_task
+ * ---------------------
+ * Description: turn the sums of a run of points into sums from point 0.
+ * Parameter: arg: the struct track_task.
+ * Return: NULL.
+ */
+void *offset_task(void *arg)
+{
+	struct track_task *task = arg;
+	size_t num;
+	for ( num = task -> begin; num < task -> end; num++ )
+	{
+		task -> cum[num] += task -> offset;
+	}
+	return NULL;
+}
+
+/*
+ * Function: split_task
+ * --------------------
+ * Description: complete a run of splits as close_split() does, adding up the distance of
+ *              each point by point from zero. The last point of a split must be the first
+ *              at which the sum reaches SPLIT_LENGTH, except that the last split may end
+ *              short of it at the end of the track.
+ * Parameter: arg: the struct track_task.
+ * Return: NULL.
+ */
+void *split_task(void *arg)
+{
+	struct track_task *task = arg;
+	const struct track *tr = task -> tr;
+	size_t split, num, first, last;
+	double length;
+	for ( split = task -> begin; split < task -> end; split++ )
 	{
-		// First work through the header in the GPX file.
-		// Assume header finishes at "</trkseg>" stored in endOfHdr.
-		while ( fgets(theLine, sizeof theLine, fpn)
-				&& ((strncmp(theLine, endOfHdr, strlen(endOfHdr)) != 0)) )
+		first = task -> bounds[split];
+		last = task -> bounds[split + 1];
+		length = 0.0;
+		for ( num = first + 1; num <= last; num++ )
 		{
-			// Skip through the file until "<trkseg>" is reached (endOfHdr).
-			lineNum++;
+			length += task -> dist[num];
+			if ( length >= SPLIT_LENGTH && num < last )
+			{
+				task -> mismatch = true;
+			}
 		}
-		// Read the text data and store the lat, lon and time data in a linked list.
-		while ( fgets(theLine, sizeof theLine, fpn)
-				&& ((strncmp(theLine, endOfData, strlen(endOfData)) != 0)) )
-		// Finish when "</trkseg>" reached (endOfData).
+		if ( length < SPLIT_LENGTH && last < tr -> num - 1 )
 		{
-			lat = read_double_after_token(theLine, "lat=\"", &currPosition);
-			lon = read_double_after_token(currPosition, "lon=\"", &currPosition);
-			ele = read_double_after_token(currPosition, "<ele>", &currPosition);
-			// Speed up the whole process of reading data by shortening the string every time.
-			add_to_list(lat, lon, ele, read_string_after_token(currPosition, "<time>", tempTimeStr, 20));
- 			// Date and time in are in Univeral Coordinated Time (UTC), not local time.
-			lineNum++;
+			task -> mismatch = true;
 		}
+		task -> splits[split].splitNo = (int) split + 1;
+		task -> splits[split].length = length;
+		task -> splits[split].pace = (long int) (tr -> t[last] - tr -> t[first]);
+		task -> splits[split].speed = length * 3.6 / (double) task -> splits[split].pace;
+		task -> splits[split].elevDiff = tr -> ele[last] - tr -> ele[first];
 	}
-	fclose(fpn);
+	return NULL;
 }
 
 /*
- * Function: read_string_after_token
- * ---------------------------------
- * Description: This function will return a double from string txtstr.
- *              The string will be searched for the first occurrence of tkn and
- *				the reading of the double will start steps places after the start of tkn.
- * 				If the token is not found in the string it returns a value of -1.0.
- * 				If there is no number after the token it returns 0.0.
- * Parameters: txtStr: the string which will be parsed;
- *             tkn: the token which will be found;
- *             endPtr: return an address of the next character in txtStr after the numerical value.
- * Return: res: the number read from txtStr.
+ * Function: begin_track
+ * ---------------------
+ * Description: start the running totals of a track.
+ * Parameters: st: return the running totals;
+ *             printSplits: print the splits as they are completed instead of keeping them.
+ * Return: N/A.
  */
-double read_double_after_token(char *txtStr, char *tkn, char **endPtr)
+void begin_track(struct track_stats *st, _Bool printSplits)
 {
-	int steps = strlen(tkn);
-	double res = -1.0;
-	char *tmpStr = strstr(txtStr, tkn);
-	if ( tmpStr )
-	// Check to make sure the pointer is not NULL, i.e. strstr returned something.
-	{
-		res = strtod(tmpStr + steps, endPtr);
-	}
-	return res;
+	memset(st, 0, sizeof(struct track_stats));
+	st -> printSplits = printSplits;
 }
 
 /*
- * Function: read_string_after_token
- * ---------------------------------
- * Description: This function will return a  substring from string txtstr.
- * 				The string will be searched for the first occurrence of tkn
- * 				and then a substring on length len will be returned starting steps
- * 				spaces from the start of tkn.
- * 				If the token is not found in the string it returns a null pointer.
- * Parameters: txtStr: the string which will be parsed;
- *             tkn: the token which will be found;
- *             res: the temp string used to store the content;
- *             len: the length of string which needs to be copied;
- * Return: ret: the address of object string.
+ * Function: add_point
+ * -------------------
+ * Description: add the next point of the track to the running totals, working out
+ *              its distance from the point before.
+ * Parameters: st: the running totals;
+ *             pt: the point.
+ * Return: N/A.
  */
-char *read_string_after_token(char *txtStr, char *tkn, char *res, int len)
-// Target string, token, length of substring and steps beyond start of token.
+void add_point(struct track_stats *st, const struct point *pt)
 {
-	int steps = strlen(tkn);
-	char *ret, *tmpStr = strstr(txtStr, tkn);
-	if ( tmpStr )
+	double cosLat = cos(pt -> lat * D2R);
+	double dist = 0.0;
+	if ( st -> pointNum > 0 )
 	{
-		// Checking to make sure the pointer is not NULL, i.e. strstr returned something.
-		ret = strncpy(res, tmpStr+steps, len);
-		*(ret+len) = '\0';
-		// Add null character at the end of the string explicitly.
+		dist = haversine_m(st -> latPrev, st -> lonPrev, st -> cosLatPrev, pt -> lat, pt -> lon, cosLat);
 	}
-	return ret;
+	add_segment(st, pt, dist);
+	st -> cosLatPrev = cosLat;
 }
 
 /*
- * Function: add_to_list
+ * Function: add_segment
  * ---------------------
- * Description: add nodes to the main data list.
- * Parameters: lat: the latitude;
- *             lon: the longitude;
- *             ele: the elevation;
- *             timeStr: the time string.
+ * Description: add the next point of the track to the running totals, completing
+ *              a split when it reaches SPLIT_LENGTH.
+ * Parameters: st: the running totals;
+ *             pt: the point;
+ *             dist: its distance from the point before (ignored for the first point).
  * Return: N/A.
  */
-void add_to_list(double lat, double lon, double ele, char *timeStr)
+void add_segment(struct track_stats *st, const struct point *pt, double dist)
 {
-	if ( NULL == head )
-	// Yoda expression. "Nice" walkaround.
+	if ( st -> pointNum == 0 )
+	// First node.
 	{
-		create_list(lat, lon, ele, timeStr);
-		return; // Terminate the current function.
+		st -> startTime = st -> startTimeSplit = pt -> t;
+		st -> startElevationSplit = pt -> ele;
+		if ( st -> printSplits )
+		{
+			print_splits_header();
+		}
 	}
-	struct node *ptr = malloc(sizeof(struct node));
-	if ( NULL == ptr )
+	else
 	{
-		perror("Node creation failed");
-		exit(EXIT_FAILURE);
+		st -> pathLen += dist;
+		st -> splitLen += dist;
+		st -> splitOpen = true;
+		if ( st -> splitLen >= SPLIT_LENGTH )
+		// Create a new split when splitLen reached SPLIT_LENGTH.
+		{
+			close_split(st, pt -> ele, pt -> t);
+		}
+	}
+	if ( st -> engine )
+	{
+		scheme_point(st -> engine, dist, pt -> t, pt -> ele);
 	}
-	ptr -> lat = lat;
-	ptr -> lon = lon;
-	ptr -> ele = ele;
-	strcpy(ptr -> timeString, timeStr);
-	ptr -> next = NULL;
-	curr -> next = ptr;
-	curr = ptr;
+	// Update the location information.
+	st -> latPrev = pt -> lat;
+	st -> lonPrev = pt -> lon;
+	st -> elePrev = pt -> ele;
+	st -> timePrev = pt -> t;
+	st -> pointNum++;
 }
 
 /*
- * Function: create_list
+ * Function: close_split
  * ---------------------
- * Description: create the list to be used to store the data.
- * Parameters: lat: the latitude;
- *             lon: the longitude;
- *             ele: the elevation;
- *             timeStr: the time string.
+ * Description: complete the current split at a point and begin a new one there.
+ * Parameters: st: the running totals;
+ *             ele: the elevation of the point;
+ *             t: the time of the point.
  * Return: N/A.
  */
-void create_list(double lat, double lon, double ele, char *timeStr)
+void close_split(struct track_stats *st, double ele, long long t)
 {
-	struct node *ptr = malloc(sizeof(struct node));
-	if ( NULL == ptr )
+	long int averagePaceSplit;
+	double speed;
+	st -> splitNo++;
+	averagePaceSplit = (long int) (t - st -> startTimeSplit);
+	speed = st -> splitLen * 3.6 / (double) averagePaceSplit;
+	// (splitLen / 1000.0) / ((double) averagePaceSplit / 3600.0)
+	if ( st -> printSplits )
 	{
-		perror("Node creation failed");
-		exit(EXIT_FAILURE);
+		print_split(st -> splitNo, averagePaceSplit, speed, ele - st -> startElevationSplit);
+	}
+	else
+	{
+		add_to_splits_list(st, st -> splitNo, st -> splitLen, averagePaceSplit, speed,
+		                   ele - st -> startElevationSplit);
 	}
-	ptr -> lat = lat;
-	ptr -> lon = lon;
-	ptr -> ele = ele;
-	strcpy(ptr -> timeString, timeStr);
-	ptr -> next = NULL;
-	head = curr = ptr;
+	st -> splitLen = 0.0; // Clear the variable and begin a new split.
+	st -> startElevationSplit = ele;
+	st -> startTimeSplit = t;
+	st -> splitOpen = false;
 }
 
 /*
- * Function: calculate_tot_dist
- * ----------------------------
- * Description: calculate the total length of the track and print out the statistics.
- * Parameter: N/A.
+ * Function: end_track
+ * -------------------
+ * Description: complete the last split at the last point, unless it has just been completed,
+ *              and the last split of every scheme of -s.
+ * Parameter: st: the running totals.
  * Return: N/A.
- * Bug: mktime function only accepts local time as argument instead of UTC and
- *      it may cause potential problems (time calculated by mktime is smaller
- *      than (3600 seconds) what user expects due to daylight savings switch and time zone.
- *      Without considering portability, replacing mktime() with timegm() is a better option.
- *      See also: https://sourceware.org/bugzilla/show_bug.cgi?id=4033
  */
-void calculate_tot_dist(void)
+void end_track(struct track_stats *st)
 {
-	enum { FIRST, NOTFIRST } firstNodeFlag = FIRST;
-	double distBetwPoints;
+	if ( st -> splitOpen )
+	{
+		close_split(st, st -> elePrev, st -> timePrev);
+	}
+	if ( st -> engine )
+	{
+		end_schemes(st -> engine);
+	}
+}
 
-	// Variables used in "Overall Statistics".
-	double pathLen = 0.0, latPrev, lonPrev, averagePace;
+/*
+ * Function: print_overall
+ * -----------------------
+ * Description: print the overall statistics of a track.
+ * Parameter: st: the running totals after the last point.
+ * Return: N/A.
+ */
+void print_overall(struct track_stats *st)
+{
 	long int elapsedTime;
-	struct tm startTime, finishTime;
-	// Hold the start and end time.
-	struct node *ptr = head;
-
-	// Variables used in "Splits Statistics".
-	int splitNo = 0;
-	long int averagePaceSplit;
-	double splitLen = 0.0, startElevationSplit, finishElevationSplit;
-	struct tm startTimeSplit, finishTimeSplit;
-	// Hold the start and end time of each split.
-	struct split *ptrSplit;
-
-    while ( ptr != NULL )
-	{
-		if ( firstNodeFlag == FIRST )
-    	// First node.
-		{
-			strptime(ptr -> timeString, "%Y-%m-%dT%TZ", &startTime);
-			/*
-			 * There is no strptime function in ISO C (just in POSIX).
-			 * strptime is a function to populate a tm time structure from an GPX time string.
-			 * e.g. "2013-09-12T15:59:18Z"
-			 */
-			startTimeSplit = startTime;
-			startElevationSplit = ptr -> ele;
-			firstNodeFlag = NOTFIRST;
-    	}
-		else
-    	{
-			distBetwPoints = haversine_m(latPrev, lonPrev, ptr -> lat, ptr -> lon);
-			pathLen += distBetwPoints;
-			splitLen += distBetwPoints;
-			if ( (splitLen >= 1000.0) || (ptr -> next == NULL) )
-			/*
-			 * Create a new split when splitLen reached 1000.0 or
-			 * the current point is the last one in the linked list.
-			 */
-			{
-				splitNo++;
-				strptime(ptr -> timeString, "%Y-%m-%dT%TZ", &finishTimeSplit);
-				// %T: Equivalent to %H:%M:%S.
-				averagePaceSplit = (long int) difftime(mktime(&finishTimeSplit), mktime(&startTimeSplit));
-				// Return the time difference in seconds between two tm time structures.
-				finishElevationSplit = ptr -> ele;
-				add_to_splits_list(splitNo,
-				                   averagePaceSplit,
-				                   splitLen * 3.6 / (double) averagePaceSplit,
-				                   // (splitLen / 1000.0) / ((double) averagePaceSplit / 3600.0),
-				                   finishElevationSplit - startElevationSplit);
-				splitLen = 0.0; // Clear the variable and begin a new split.
-				startElevationSplit = finishElevationSplit;
-				startTimeSplit = finishTimeSplit;
-			}
-    	}
-		// Update the location information and go to next node.
-		latPrev = ptr -> lat;
-		lonPrev = ptr -> lon;
-		ptr = ptr -> next;
-    }
-	// Print results on the screen.
+	double averagePace;
 	printf("\n-------Overall Statistics-------\n");
-    printf("Path Length: %5.0f m\n", pathLen);
-	strptime(curr -> timeString, "%Y-%m-%dT%TZ", &finishTime);
-	// The structure pointed by curr still store the data of the last node.
-	elapsedTime = (long int) difftime(mktime(&finishTime), mktime(&startTime));
+	printf("Path Length: %5.0f m\n", st -> pathLen);
+	elapsedTime = (long int) (st -> timePrev - st -> startTime);
+	// Both are UTC, so daylight saving time and time zones play no part.
 	printf("Elapsed Time: %ld sec\n", elapsedTime);
-	averagePace = (double) elapsedTime * 50.0 / pathLen / 3.0;
+	averagePace = (double) elapsedTime * 50.0 / st -> pathLen / 3.0;
 	// averagePace = (double) elapsedTime / (pathLen / 1000.0) / 60.0;
 	printf("Average Pace: %4.2f m/km\n", averagePace);
+}
+
+/*
+ * Function: print_splits_header
+ * -----------------------------
+ * Description: print the title and the column names of the splits.
+ * Parameter: N/A.
+ * Return: N/A.
+ */
+void print_splits_header(void)
+{
 	printf("\n-------Splits Statistics-------\n");
 	printf("--------------------------------------------------\n");
 	printf(" Split No. | Pace m:s | Speed km/h | Elevation m\n");
 	printf("--------------------------------------------------\n");
-	ptrSplit = headSplit;
-	while ( ptrSplit != NULL )
-	{
-		printf("%6d %12s %11.2f %11.0f\n", ptrSplit -> splitNo,
-	                                       sec_to_clock_time(ptrSplit -> pace),
-	                                       ptrSplit -> speed,
-	                                       ptrSplit -> elevDiff);
-		ptrSplit = ptrSplit -> next;
-	}
+}
+
+/*
+ * Function: print_split
+ * ---------------------
+ * Description: print one row of the splits.
+ * Parameters: splitNo: the number of the split;
+ *             pace: the duration of the split;
+ *             speed: the average speed;
+ *             elevDiff: the difference in elevation.
+ * Return: N/A.
+ */
+void print_split(int splitNo, long int pace, double speed, double elevDiff)
+{
+	printf("%6d %12s %11.2f %11.0f\n", splitNo, sec_to_clock_time(pace), speed, elevDiff);
+}
+
+/*
+ * Function: print_splits_footer
+ * -----------------------------
+ * Description: print the line closing the splits.
+ * Parameter: N/A.
+ * Return: N/A.
+ */
+void print_splits_footer(void)
+{
 	printf("--------------------------------------------------\n");
 	printf("-------Splits Statistics End-------\n\n");
 }
@@ -347,38 +2043,291 @@ void calculate_tot_dist(void)
  * Function: haversine_m
  * ---------------------
  * Description: calculate distance between two points expressed as lat and long.
+ *              Each point comes with the cosine of its latitude, which the caller works
+ *              out once per point rather than once per distance.
  * Parameters: lat1: the latitude of point 1;
  *             lon1: the longitude of point 1;
+ *             cosLat1: cos(lat1 * D2R);
  *             lat2: the latitude of point 2;
- *             lon2: the longitude of point 2.
+ *             lon2: the longitude of point 2;
+ *             cosLat2: cos(lat2 * D2R).
  * Return: d: the distance between two points.
  */
-double haversine_m(double lat1, double lon1, double lat2, double lon2)
+double haversine_m(double lat1, double lon1, double cosLat1, double lat2, double lon2, double cosLat2)
 {
 	// Haversine formula.
 	double dlong = (lon2 - lon1) * D2R;
 	double dlat = (lat2 - lat1) * D2R;
-	double a = pow(sin(dlat / 2.0), 2.0) + cos(lat1 * D2R) * cos(lat2 * D2R) * pow(sin(dlong / 2.0), 2.0);
+	double a = pow(sin(dlat / 2.0), 2.0) + cosLat1 * cosLat2 * pow(sin(dlong / 2.0), 2.0);
 	double c = 2.0 * atan2(sqrt(a), sqrt(1.0 - a));
-	double d = 6367137.0 * c;
+	double d = EARTH_RADIUS * c;
 	return d;
 }
 
+/*
+ * Function: track_distances
+ * -------------------------
+ * Description: work out the distance of every point in a run of the track from the one
+ *              before. By default it is haversine_m() with the cosine of each latitude
+ *              worked out once; the fast kernel goes through the points FAST_LANES at a
+ *              time, in its AVX2 copy if the processor has it. Only dist[begin, end) is
+ *              written, so that runs can be worked out at the same time.
+ * Parameters: tr: the track;
+ *             begin, end: the run of points;
+ *             dist: return the distances, dist[0] = 0 and dist[n] from point n - 1 to n;
+ *             fast: use the fast kernel.
+ * Return: N/A.
+ */
+void track_distances(const struct track *tr, size_t begin, size_t end, double *dist, _Bool fast)
+{
+	size_t num, first = begin ? begin - 1 : 0;
+	double *cosLat;
+	struct track run = { tr -> lat + first, tr -> lon + first, tr -> ele + first, tr -> t + first, end - first, 0,
+	                     NULL, NULL, NULL, 0 };
+	// The run and the point before it, so that the kernels start at its second point.
+	if ( end <= begin )
+	{
+		return;
+	}
+	if ( begin == 0 )
+	{
+		dist[0] = 0.0;
+	}
+	dist += first;
+	tr = &run;
+	cosLat = malloc(sizeof(double) * tr -> num);
+	if ( cosLat == NULL )
+	{
+		perror("cosLat");
+		exit(EXIT_FAILURE);
+	}
+#ifdef FAST_KERNEL
+	if ( fast )
+	{
+#ifdef FAST_KERNEL_AVX2
+		if ( __builtin_cpu_supports("avx2") )
+		{
+			fast_distances_avx2(tr, cosLat, dist);
+		}
+		else
+#endif
+		{
+			fast_distances_generic(tr, cosLat, dist);
+		}
+		free(cosLat);
+		return;
+	}
+#else
+	(void) fast;
+#endif
+	for ( num = 0; num < tr -> num; num++ )
+	{
+		cosLat[num] = cos(tr -> lat[num] * D2R);
+	}
+	for ( num = 1; num < tr -> num; num++ )
+	{
+		dist[num] = haversine_m(tr -> lat[num - 1], tr -> lon[num - 1], cosLat[num - 1],
+		                        tr -> lat[num], tr -> lon[num], cosLat[num]);
+	}
+	free(cosLat);
+}
+
+#ifdef FAST_KERNEL
+/*
+ * Function: load_lanes
+ * --------------------
+ * Description: load FAST_LANES values, repeating the last one past the end of the array.
+ * Parameters: v: return the lanes;
+ *             src: the first value;
+ *             avail: how many values there are from src on (at least 1).
+ * Return: N/A.
+ */
+static inline __attribute__((always_inline)) void load_lanes(lanes *v, const double *src, size_t avail)
+{
+	int k;
+	if ( avail >= FAST_LANES )
+	{
+		memcpy(v, src, sizeof(lanes));
+		return;
+	}
+	for ( k = 0; k < FAST_LANES; k++ )
+	{
+		(*v)[k] = src[(size_t) k < avail ? (size_t) k : avail - 1];
+	}
+}
+
+/*
+ * Function: store_lanes
+ * ---------------------
+ * Description: store the lanes that fall inside the array.
+ * Parameters: dst: where the first lane goes;
+ *             v: the lanes;
+ *             avail: how many values there is room for from dst on.
+ * Return: N/A.
+ */
+static inline __attribute__((always_inline)) void store_lanes(double *dst, const lanes *v, size_t avail)
+{
+	int k;
+	if ( avail >= FAST_LANES )
+	{
+		memcpy(dst, v, sizeof(lanes));
+		return;
+	}
+	for ( k = 0; (size_t) k < avail; k++ )
+	{
+		dst[k] = (*v)[k];
+	}
+}
+
+/*
+ * Function: fast_kernel
+ * ---------------------
+ * Description: the haversine formula FAST_LANES distances at a time. The cosine of
+ *              every latitude is a Taylor polynomial of degree 16 up to pi/4 and, beyond,
+ *              the sine of the colatitude as one of degree 17, so that it is as accurate
+ *              near the poles as at the equator. Consecutive points are close, so the sines
+ *              of half the differences of latitude and longitude are Taylor polynomials of
+ *              degree 7 and the arcsine of the square root of a is one of degree 9, which
+ *              replaces 2 * atan2(sqrt(a), sqrt(1 - a)). All of them are truncated below
+ *              1e-17 relative, so the error is that of rounding: within 2e-15 of the
+ *              distance of the default, e.g. 2e-11 m for a 10 km step. Lanes outside
+ *              these ranges, i.e. half differences over FAST_ANGLE (a gap of more than
+ *              about 64 km) or latitudes beyond 90 degrees, use the math library instead.
+ *              It is compiled once per instruction set by the functions below.
+ * Parameters: tr: the track, with at least one point;
+ *             cosLat: return cos(lat * D2R) of every point;
+ *             dist: return the distances from the second point on, as in track_distances().
+ * Return: N/A.
+ */
+static inline __attribute__((always_inline)) void fast_kernel(const struct track *tr, double *cosLat, double *dist)
+{
+	size_t num, avail;
+	int k;
+	lanes x, x2, y, y2, c, a, h, p, q;
+	for ( num = 0; num < tr -> num; num += FAST_LANES )
+	{
+		avail = tr -> num - num;
+		load_lanes(&x, tr -> lat + num, avail);
+		x = x * D2R;
+		for ( k = 0; k < FAST_LANES; k++ )
+		{
+			x[k] = fabs(x[k]);
+		}
+		x2 = x * x;
+		c = 1.0 / 20922789888000.0 * x2 - 1.0 / 87178291200.0;
+		c = c * x2 + 1.0 / 479001600.0;
+		c = c * x2 - 1.0 / 3628800.0;
+		c = c * x2 + 1.0 / 40320.0;
+		c = c * x2 - 1.0 / 720.0;
+		c = c * x2 + 1.0 / 24.0;
+		c = c * x2 - 1.0 / 2.0;
+		c = c * x2 + 1.0;
+		// cos(x) up to x^16.
+		y = (M_PI / 2.0 - x) + PI_2_LOW;
+		// Exact up to pi/2 - x >= pi/4, by Sterbenz's lemma.
+		y2 = y * y;
+		h = 1.0 / 355687428096000.0 * y2 - 1.0 / 1307674368000.0;
+		h = h * y2 + 1.0 / 6227020800.0;
+		h = h * y2 - 1.0 / 39916800.0;
+		h = h * y2 + 1.0 / 362880.0;
+		h = h * y2 - 1.0 / 5040.0;
+		h = h * y2 + 1.0 / 120.0;
+		h = h * y2 - 1.0 / 6.0;
+		h = y * (h * y2 + 1.0);
+		// sin(pi/2 - x) up to (pi/2 - x)^17.
+		for ( k = 0; k < FAST_LANES; k++ )
+		{
+			if ( x[k] > M_PI / 4.0 )
+			{
+				c[k] = x[k] <= M_PI / 2.0 ? h[k] : cos(x[k]);
+				// Beyond pi/2 it is not a latitude and neither polynomial holds.
+			}
+		}
+		store_lanes(cosLat + num, &c, avail);
+	}
+	for ( num = 1; num < tr -> num; num += FAST_LANES )
+	{
+		avail = tr -> num - num;
+		load_lanes(&p, tr -> lat + num - 1, avail);
+		load_lanes(&q, tr -> lat + num, avail);
+		x = (q - p) * (D2R / 2.0);
+		load_lanes(&p, tr -> lon + num - 1, avail);
+		load_lanes(&q, tr -> lon + num, avail);
+		y = (q - p) * (D2R / 2.0);
+		x2 = x * x;
+		y2 = y * y;
+		x = x * (((-1.0 / 5040.0 * x2 + 1.0 / 120.0) * x2 - 1.0 / 6.0) * x2 + 1.0);
+		y = y * (((-1.0 / 5040.0 * y2 + 1.0 / 120.0) * y2 - 1.0 / 6.0) * y2 + 1.0);
+		// sin(x) and sin(y)
+		load_lanes(&p, cosLat + num - 1, avail);
+		load_lanes(&q, cosLat + num, avail);
+		a = x * x + p * q * (y * y);
+		for ( k = 0; k < FAST_LANES; k++ )
+		{
+			h[k] = sqrt(a[k]);
+		}
+		a = h * h;
+		h = h * ((((35.0 / 1152.0 * a + 5.0 / 112.0) * a + 3.0 / 40.0) * a + 1.0 / 6.0) * a + 1.0);
+		// asin(h)
+		h = h * (2.0 * EARTH_RADIUS);
+		for ( k = 0; (size_t) k < avail && k < FAST_LANES; k++ )
+		{
+			if ( !(x2[k] <= FAST_ANGLE * FAST_ANGLE && y2[k] <= FAST_ANGLE * FAST_ANGLE) )
+			// Too far apart for the polynomials, or not a number.
+			{
+				h[k] = haversine_m(tr -> lat[num + k - 1], tr -> lon[num + k - 1], cosLat[num + k - 1],
+				                   tr -> lat[num + k], tr -> lon[num + k], cosLat[num + k]);
+			}
+		}
+		store_lanes(dist + num, &h, avail);
+	}
+}
+
+/*
+ * Function: fast_distances_generic
+ * --------------------------------
+ * Description: fast_kernel() for any processor.
+ * Parameters: as fast_kernel().
+ * Return: N/A.
+ */
+void fast_distances_generic(const struct track *tr, double *cosLat, double *dist)
+{
+	fast_kernel(tr, cosLat, dist);
+}
+
+#ifdef FAST_KERNEL_AVX2
+/*
+ * Function: fast_distances_avx2
+ * -----------------------------
+ * Description: fast_kernel() with all FAST_LANES lanes in one AVX2 register.
+ * Parameters: as fast_kernel().
+ * Return: N/A.
+ */
+__attribute__((target("avx2"))) void fast_distances_avx2(const struct track *tr, double *cosLat, double *dist)
+{
+	fast_kernel(tr, cosLat, dist);
+}
+#endif
+#endif
+
 /*
  * Function: create_splits
  * -----------------------
  * Description: add nodes to the main data list.
- * Parameters: splitNo: the number of the current split;
+ * Parameters: st: the running totals holding the list;
+ *             splitNo: the number of the current split;
+ *             length: the distance covered in this split;
  *             pace: the duration in this split;
  *             speed: the average speed;
  *             eleDiff: the difference between current point and the last point in previous split.
  * Return: N/A.
  */
-void add_to_splits_list(int splitNo, long int pace, double speed, double elevDiff)
+void add_to_splits_list(struct track_stats *st, int splitNo, double length, long int pace, double speed,
+                        double elevDiff)
 {
-	if ( NULL == headSplit )
+	if ( NULL == st -> headSplit )
 	{
-		create_splits(splitNo, pace, speed, elevDiff);
+		create_splits(st, splitNo, length, pace, speed, elevDiff);
 		return; // Terminate the current function.
 	}
 	struct split *splitPtr = malloc(sizeof(struct split));
@@ -388,25 +2337,29 @@ void add_to_splits_list(int splitNo, long int pace, double speed, double elevDif
 		exit(EXIT_FAILURE);
 	}
 	splitPtr -> splitNo = splitNo;
+	splitPtr -> length = length;
 	splitPtr -> pace = pace;
 	splitPtr -> speed = speed;
 	splitPtr -> elevDiff = elevDiff;
 	splitPtr -> next = NULL;
-	currSplit -> next = splitPtr;
-	currSplit = splitPtr;
+	st -> currSplit -> next = splitPtr;
+	st -> currSplit = splitPtr;
 }
 
 /*
  * Function: create_splits
  * -----------------------
  * Description: create the list to be used to store the data.
- * Parameters: splitNo: the number of the current split;
+ * Parameters: st: the running totals holding the list;
+ *             splitNo: the number of the current split;
+ *             length: the distance covered in this split;
  *             pace: the duration in this split;
  *             speed: the average speed;
  *             eleDiff: the difference between current point and the last point in previous split.
  * Return: N/A.
  */
-void create_splits(int splitNo, long int pace, double speed, double elevDiff)
+void create_splits(struct track_stats *st, int splitNo, double length, long int pace, double speed,
+                   double elevDiff)
 {
 	struct split *splitPtr = malloc(sizeof(struct split));
 	if ( NULL == splitPtr )
@@ -415,11 +2368,288 @@ void create_splits(int splitNo, long int pace, double speed, double elevDiff)
 		exit(EXIT_FAILURE);
 	}
 	splitPtr -> splitNo = splitNo;
+	splitPtr -> length = length;
 	splitPtr -> pace = pace;
 	splitPtr -> speed = speed;
 	splitPtr -> elevDiff = elevDiff;
 	splitPtr -> next = NULL;
-	headSplit = currSplit = splitPtr;
+	st -> headSplit = st -> currSplit = splitPtr;
+}
+
+/*
+ * Function: free_splits
+ * ---------------------
+ * Description: release the list of splits and leave it empty.
+ * Parameter: st: the running totals holding the list.
+ * Return: N/A.
+ */
+void free_splits(struct track_stats *st)
+{
+	struct split *splitPtr;
+	while ( st -> headSplit != NULL )
+	{
+		splitPtr = st -> headSplit;
+		st -> headSplit = splitPtr -> next;
+		free(splitPtr);
+	}
+	st -> currSplit = NULL;
+}
+
+/*
+ * Function: parse_schemes
+ * -----------------------
+ * Description: read a comma-separated list of split schemes, such as "1km,1mi,400m,5min",
+ *              and add them to the options. A scheme is a positive number (1 if left out)
+ *              followed by one of the units m, km, mi, s, min and h.
+ * Parameters: spec: the list;
+ *             opt: the options to add the schemes to.
+ * Return: 0, or -1 if a scheme cannot be read.
+ */
+int parse_schemes(const char *spec, struct options *opt)
+{
+	static const struct
+	{
+		const char *unit;
+		double size;
+		_Bool byTime;
+	} units[] = { { "m", 1.0, false }, { "km", 1000.0, false }, { "mi", MILE, false },
+	              { "s", 1.0, true }, { "min", 60.0, true }, { "h", 3600.0, true } };
+	struct split_scheme *scheme;
+	const char *end;
+	char *unit;
+	size_t len, num;
+	double value;
+	while ( *spec )
+	{
+		end = spec + strcspn(spec, ",");
+		len = end - spec;
+		if ( len == 0 || len >= SCHEME_NAME )
+		{
+			return -1;
+		}
+		opt -> schemes = realloc(opt -> schemes, sizeof(struct split_scheme) * (opt -> schemeNum + 1));
+		if ( opt -> schemes == NULL )
+		{
+			perror("schemes");
+			exit(EXIT_FAILURE);
+		}
+		scheme = &opt -> schemes[opt -> schemeNum];
+		memcpy(scheme -> name, spec, len);
+		scheme -> name[len] = '\0';
+		value = strtod(scheme -> name, &unit);
+		if ( unit == scheme -> name )
+		{
+			value = 1.0;
+		}
+		for ( num = 0; num < sizeof(units) / sizeof(units[0]); num++ )
+		{
+			if ( strcmp(unit, units[num].unit) == 0 )
+			{
+				break;
+			}
+		}
+		scheme -> step = value * (num < sizeof(units) / sizeof(units[0]) ? units[num].size : 0.0);
+		scheme -> byTime = num < sizeof(units) / sizeof(units[0]) && units[num].byTime;
+		if ( !(scheme -> step > 0.0) || !isfinite(scheme -> step) )
+		// An unknown unit, or not a positive length.
+		{
+			return -1;
+		}
+		opt -> schemeNum++;
+		spec = *end ? end + 1 : end;
+	}
+	return 0;
+}
+
+/*
+ * Function: begin_schemes
+ * -----------------------
+ * Description: start the split engine for the schemes of the options.
+ * Parameters: en: return the engine;
+ *             opt: the schemes.
+ * Return: N/A.
+ */
+void begin_schemes(struct split_engine *en, const struct options *opt)
+{
+	int num;
+	memset(en, 0, sizeof(struct split_engine));
+	en -> states = calloc(opt -> schemeNum, sizeof(struct scheme_state));
+	if ( en -> states == NULL )
+	{
+		perror("schemes");
+		exit(EXIT_FAILURE);
+	}
+	en -> schemeNum = opt -> schemeNum;
+	for ( num = 0; num < en -> schemeNum; num++ )
+	{
+		en -> states[num].scheme = &opt -> schemes[num];
+	}
+}
+
+/*
+ * Function: scheme_point
+ * ----------------------
+ * Description: advance every scheme to the next point. Each boundary between the point
+ *              before and this one completes a split there, with the time (or, for laps,
+ *              the distance) and the elevation interpolated linearly along the segment.
+ *              The boundaries are whole multiples of the step from the start, so they
+ *              do not drift however many splits there are.
+ * Parameters: en: the engine;
+ *             dist: the distance from the point before (ignored for the first point);
+ *             t: the time of the point;
+ *             ele: the elevation of the point.
+ * Return: N/A.
+ */
+void scheme_point(struct split_engine *en, double dist, long long t, double ele)
+{
+	struct scheme_state *ss;
+	double endDist, endTime = (double) t, boundary, fraction, time, along, height;
+	if ( !en -> started )
+	{
+		en -> started = true;
+		en -> time = en -> firstTime = endTime;
+		en -> ele = ele;
+		for ( ss = en -> states; ss < en -> states + en -> schemeNum; ss++ )
+		{
+			ss -> startTime = endTime;
+			ss -> startEle = ele;
+		}
+		return;
+	}
+	endDist = en -> dist + dist;
+	for ( ss = en -> states; ss < en -> states + en -> schemeNum; ss++ )
+	{
+		while ( true )
+		{
+			boundary = (ss -> boundaryNo + 1) * ss -> scheme -> step;
+			if ( ss -> scheme -> byTime )
+			{
+				boundary += en -> firstTime;
+				if ( !(boundary <= endTime && endTime > en -> time) )
+				{
+					break;
+				}
+				fraction = (boundary - en -> time) / (endTime - en -> time);
+				time = boundary;
+				along = en -> dist + fraction * dist;
+			}
+			else
+			{
+				if ( !(boundary <= endDist && dist > 0.0) )
+				{
+					break;
+				}
+				fraction = (boundary - en -> dist) / dist;
+				time = en -> time + fraction * (endTime - en -> time);
+				along = boundary;
+			}
+			height = en -> ele + fraction * (ele - en -> ele);
+			add_lap(ss, along - ss -> startDist, time - ss -> startTime, height - ss -> startEle);
+			ss -> boundaryNo++;
+			ss -> startDist = along;
+			ss -> startTime = time;
+			ss -> startEle = height;
+		}
+	}
+	en -> dist = endDist;
+	en -> time = endTime;
+	en -> ele = ele;
+}
+
+/*
+ * Function: add_lap
+ * -----------------
+ * Description: append a completed split to a scheme, growing its array when it is full.
+ * Parameters: ss: the scheme;
+ *             length, duration, elevDiff: the split.
+ * Return: N/A.
+ */
+void add_lap(struct scheme_state *ss, double length, double duration, double elevDiff)
+{
+	if ( ss -> lapNum == ss -> lapCap )
+	{
+		ss -> lapCap = ss -> lapCap ? ss -> lapCap * 2 : INITIAL_LAPS;
+		ss -> laps = realloc(ss -> laps, sizeof(struct lap) * ss -> lapCap);
+		if ( ss -> laps == NULL )
+		{
+			perror("laps");
+			exit(EXIT_FAILURE);
+		}
+	}
+	ss -> laps[ss -> lapNum].length = length;
+	ss -> laps[ss -> lapNum].duration = duration;
+	ss -> laps[ss -> lapNum].elevDiff = elevDiff;
+	ss -> lapNum++;
+}
+
+/*
+ * Function: end_schemes
+ * ---------------------
+ * Description: complete the last split of every scheme at the last point, unless it
+ *              ended exactly on a boundary.
+ * Parameter: en: the engine.
+ * Return: N/A.
+ */
+void end_schemes(struct split_engine *en)
+{
+	struct scheme_state *ss;
+	for ( ss = en -> states; ss < en -> states + en -> schemeNum; ss++ )
+	{
+		if ( en -> dist > ss -> startDist || en -> time > ss -> startTime )
+		{
+			add_lap(ss, en -> dist - ss -> startDist, en -> time - ss -> startTime, en -> ele - ss -> startEle);
+		}
+	}
+}
+
+/*
+ * Function: print_schemes
+ * -----------------------
+ * Description: print a table of the splits of every scheme, with the time to a tenth of
+ *              a second.
+ * Parameter: en: the engine after the last point.
+ * Return: N/A.
+ */
+void print_schemes(const struct split_engine *en)
+{
+	const struct scheme_state *ss;
+	size_t lap;
+	double tenths;
+	for ( ss = en -> states; ss < en -> states + en -> schemeNum; ss++ )
+	{
+		printf("-------Splits Statistics (%s)-------\n", ss -> scheme -> name);
+		printf("----------------------------------------------------------------\n");
+		printf(" Split No. | Distance m | Time m:s | Speed km/h | Elevation m\n");
+		printf("----------------------------------------------------------------\n");
+		for ( lap = 0; lap < ss -> lapNum; lap++ )
+		{
+			tenths = floor(ss -> laps[lap].duration * 10.0 + 0.5);
+			printf("%6zu %15.1f %9.0f:%04.1f %11.2f %11.0f\n", lap + 1, ss -> laps[lap].length,
+			       floor(tenths / 600.0), fmod(tenths, 600.0) / 10.0,
+			       ss -> laps[lap].length * 3.6 / ss -> laps[lap].duration, ss -> laps[lap].elevDiff);
+		}
+		printf("----------------------------------------------------------------\n");
+		printf("-------Splits Statistics (%s) End-------\n\n", ss -> scheme -> name);
+	}
+}
+
+/*
+ * Function: free_schemes
+ * ----------------------
+ * Description: release the splits of the engine.
+ * Parameter: en: the engine.
+ * Return: N/A.
+ */
+void free_schemes(struct split_engine *en)
+{
+	int num;
+	for ( num = 0; num < en -> schemeNum; num++ )
+	{
+		free(en -> states[num].laps);
+	}
+	free(en -> states);
+	en -> states = NULL;
+	en -> schemeNum = 0;
 }
 
 /*
@@ -0,0 +1,889 @@
+/*
+ *  Created on: Oct 15, 2026
+ *     Version: v1.0-1015
+ * Description: Build, save, open and query the CSR co-occurrence graph declared
+ *              in CharacterGraph.h. Downstream tools only need these two files.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+// Define it in order to use mmap() and POSIX thread barriers.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "CharacterGraph.h"
+
+#define ALIGN8(n) (((n) + 7) & ~(uint64_t) 7)
+
+// One direction of an edge while the rows are being sorted.
+struct graph_entry
+{
+	uint32_t source;
+	uint32_t target;
+	double weight;
+};
+
+// A name and its id while the name index is being sorted.
+struct graph_name
+{
+	const char *name;
+	uint32_t id;
+};
+
+// The work shared by the threads of one analytics kernel.
+struct graph_job
+{
+	const struct character_graph *g;
+	int threadNum;
+	const double *strength;
+	// The weighted degree of every node.
+	double *rank;
+	double *next;
+	double *contrib;
+	// rank / strength of every node, or 0 for nodes without edges.
+	double *partial;
+	// Two sums per thread, added up by every thread in the same order.
+	double *result;
+	double damping;
+	int iterations;
+	double tolerance;
+	pthread_barrier_t barrier;
+	uint32_t sampleNum;
+	double *centrality;
+	// One accumulator of nodeNum values per thread.
+};
+
+// One thread of a kernel, owning the nodes from begin to end - 1.
+struct graph_worker
+{
+	struct graph_job *job;
+	int index;
+	uint32_t begin;
+	uint32_t end;
+	pthread_t thread;
+};
+
+// Function declarations.
+void graph_attach(struct character_graph *g);
+_Bool graph_section(const struct graph_header *header, uint64_t at, uint64_t len, uint64_t align);
+_Bool graph_valid(struct character_graph *g, const struct graph_header *header);
+int graph_parallel(struct graph_job *job, void *(*kernel)(void *));
+void *degree_kernel(void *arg);
+void *pagerank_kernel(void *arg);
+void *betweenness_kernel(void *arg);
+int compare_entries(const void *a, const void *b);
+int compare_names(const void *a, const void *b);
+
+/*
+ * Function: graph_build
+ * ---------------------
+ * Description: lay out a graph in memory in the same form as the file.
+ * Parameters: g: return the graph;
+ *             nodeNum: the number of characters;
+ *             names: the name of every character;
+ *             edgeNum: the number of edges;
+ *             edges: the edges, each pair of characters at most once.
+ * Return: 0, or -1 if memory runs out.
+ */
+int graph_build(struct character_graph *g, uint32_t nodeNum, const char * const *names,
+                size_t edgeNum, const struct graph_edge *edges)
+{
+	struct graph_header header;
+	struct graph_entry *entries;
+	struct graph_name *sorted;
+	uint64_t *offsets, *nameOffsets, pos;
+	uint32_t *targets, *sortedIds, node;
+	double *weights;
+	char *base;
+	size_t num;
+	memset(&header, 0, sizeof(struct graph_header));
+	memcpy(header.magic, GRAPH_MAGIC, sizeof(header.magic));
+	header.nodeNum = nodeNum;
+	header.entryNum = (uint64_t) edgeNum * 2;
+	for ( node = 0; node < nodeNum; node++ )
+	{
+		header.nameBytes += strlen(names[node]) + 1;
+	}
+	header.offsetsAt = ALIGN8(sizeof(struct graph_header));
+	header.targetsAt = header.offsetsAt + (nodeNum + 1) * sizeof(uint64_t);
+	header.weightsAt = ALIGN8(header.targetsAt + header.entryNum * sizeof(uint32_t));
+	header.nameOffsetsAt = header.weightsAt + header.entryNum * sizeof(double);
+	header.namesAt = header.nameOffsetsAt + (nodeNum + 1) * sizeof(uint64_t);
+	header.sortedAt = ALIGN8(header.namesAt + header.nameBytes);
+	header.size = ALIGN8(header.sortedAt + nodeNum * sizeof(uint32_t));
+	base = calloc(1, header.size);
+	entries = malloc(sizeof(struct graph_entry) * (header.entryNum + 1));
+	sorted = malloc(sizeof(struct graph_name) * (nodeNum + 1));
+	if ( base == NULL || entries == NULL || sorted == NULL )
+	{
+		free(base);
+		free(entries);
+		free(sorted);
+		errno = ENOMEM;
+		return -1;
+	}
+	memcpy(base, &header, sizeof(struct graph_header));
+	offsets = (uint64_t *) (base + header.offsetsAt);
+	targets = (uint32_t *) (base + header.targetsAt);
+	weights = (double *) (base + header.weightsAt);
+	nameOffsets = (uint64_t *) (base + header.nameOffsetsAt);
+	sortedIds = (uint32_t *) (base + header.sortedAt);
+	for ( num = 0; num < edgeNum; num++ )
+	// Every edge goes into the rows of both of its characters.
+	{
+		entries[2 * num].source = edges[num].first;
+		entries[2 * num].target = edges[num].second;
+		entries[2 * num + 1].source = edges[num].second;
+		entries[2 * num + 1].target = edges[num].first;
+		entries[2 * num].weight = entries[2 * num + 1].weight = edges[num].weight;
+	}
+	qsort(entries, header.entryNum, sizeof(struct graph_entry), compare_entries);
+	for ( num = 0, node = 0; num < header.entryNum; num++ )
+	{
+		while ( node <= entries[num].source )
+		{
+			offsets[node++] = num;
+		}
+		targets[num] = entries[num].target;
+		weights[num] = entries[num].weight;
+	}
+	while ( node <= nodeNum )
+	{
+		offsets[node++] = header.entryNum;
+	}
+	for ( node = 0, pos = 0; node < nodeNum; node++ )
+	{
+		nameOffsets[node] = pos;
+		strcpy(base + header.namesAt + pos, names[node]);
+		pos += strlen(names[node]) + 1;
+		sorted[node].name = names[node];
+		sorted[node].id = node;
+	}
+	nameOffsets[nodeNum] = pos;
+	qsort(sorted, nodeNum, sizeof(struct graph_name), compare_names);
+	for ( node = 0; node < nodeNum; node++ )
+	{
+		sortedIds[node] = sorted[node].id;
+	}
+	free(entries);
+	free(sorted);
+	g -> base = base;
+	g -> mapped = false;
+	graph_attach(g);
+	return 0;
+}
+
+/*
+ * Function: graph_write
+ * ---------------------
+ * Description: save a graph to a file.
+ * Parameters: g: the graph;
+ *             path: the file.
+ * Return: 0, or -1 if the file cannot be written.
+ */
+int graph_write(const struct character_graph *g, const char *path)
+{
+	const struct graph_header *header = g -> base;
+	FILE *fp = fopen(path, "wb");
+	if ( fp == NULL )
+	{
+		return -1;
+	}
+	if ( fwrite(g -> base, 1, header -> size, fp) != header -> size )
+	{
+		fclose(fp);
+		return -1;
+	}
+	return fclose(fp) == 0 ? 0 : -1;
+}
+
+/*
+ * Function: graph_open
+ * --------------------
+ * Description: map a graph file into memory. Nothing is copied, but the sections and
+ *              every offset and id in them are checked against the header (see
+ *              graph_valid()), so a truncated or corrupt file is refused rather than read
+ *              out of bounds later.
+ * Parameters: g: return the graph;
+ *             path: the file.
+ * Return: 0, or -1 if the file cannot be mapped or is not a valid graph file (errno EINVAL).
+ */
+int graph_open(struct character_graph *g, const char *path)
+{
+	struct stat info;
+	const struct graph_header *header;
+	void *addr;
+	int fd = open(path, O_RDONLY);
+	if ( fd == -1 )
+	{
+		return -1;
+	}
+	if ( fstat(fd, &info) == -1 )
+	{
+		close(fd);
+		return -1;
+	}
+	if ( (size_t) info.st_size < sizeof(struct graph_header) )
+	{
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	addr = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); // The mapping stays valid after the descriptor is closed.
+	if ( addr == MAP_FAILED )
+	{
+		return -1;
+	}
+	header = addr;
+	g -> base = addr;
+	g -> mapped = true;
+	if ( memcmp(header -> magic, GRAPH_MAGIC, sizeof(header -> magic)) != 0
+	     || header -> size != (uint64_t) info.st_size || !graph_valid(g, header) )
+	{
+		munmap(addr, info.st_size);
+		g -> base = NULL;
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Function: graph_close
+ * ---------------------
+ * Description: release a graph from graph_build() or graph_open().
+ * Parameter: g: the graph.
+ * Return: N/A.
+ */
+void graph_close(struct character_graph *g)
+{
+	if ( g -> mapped )
+	{
+		munmap(g -> base, ((const struct graph_header *) g -> base) -> size);
+	}
+	else
+	{
+		free(g -> base);
+	}
+	g -> base = NULL;
+}
+
+/*
+ * Function: graph_name
+ * --------------------
+ * Description: the name of a character.
+ * Parameters: g: the graph;
+ *             node: the id of the character.
+ * Return: the name.
+ */
+const char *graph_name(const struct character_graph *g, uint32_t node)
+{
+	return g -> names + g -> nameOffsets[node];
+}
+
+/*
+ * Function: graph_find
+ * --------------------
+ * Description: look up the id of a name by binary search.
+ *              If the name list had duplicates, the first of them is found.
+ * Parameters: g: the graph;
+ *             name: the name.
+ * Return: the id, or -1 if there is no such name.
+ */
+long graph_find(const struct character_graph *g, const char *name)
+{
+	uint64_t low = 0, high = g -> nodeNum, mid;
+	while ( low < high )
+	// Find the first position whose name is not less than name.
+	{
+		mid = low + (high - low) / 2;
+		if ( strcmp(graph_name(g, g -> sortedIds[mid]), name) < 0 )
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	if ( low < g -> nodeNum && strcmp(graph_name(g, g -> sortedIds[low]), name) == 0 )
+	{
+		return (long) g -> sortedIds[low];
+	}
+	return -1L;
+}
+
+/*
+ * Function: graph_neighbours
+ * --------------------------
+ * Description: the neighbours of a character, sorted by id, and the edge weights.
+ * Parameters: g: the graph;
+ *             node: the id of the character;
+ *             ids, weights: return pointers into the graph.
+ * Return: the number of neighbours.
+ */
+size_t graph_neighbours(const struct character_graph *g, uint32_t node,
+                        const uint32_t **ids, const double **weights)
+{
+	*ids = g -> targets + g -> offsets[node];
+	*weights = g -> weights + g -> offsets[node];
+	return g -> offsets[node + 1] - g -> offsets[node];
+}
+
+/*
+ * Function: graph_weight
+ * ----------------------
+ * Description: the weight of the edge between two characters, by binary search.
+ * Parameters: g: the graph;
+ *             first, second: the ids of the characters.
+ * Return: the weight, or 0.0 if they never co-occur.
+ */
+double graph_weight(const struct character_graph *g, uint32_t first, uint32_t second)
+{
+	uint64_t low = g -> offsets[first], high = g -> offsets[first + 1], mid;
+	while ( low < high )
+	{
+		mid = low + (high - low) / 2;
+		if ( g -> targets[mid] == second )
+		{
+			return g -> weights[mid];
+		}
+		if ( g -> targets[mid] < second )
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	return 0.0;
+}
+
+/*
+ * Function: graph_top_k
+ * ---------------------
+ * Description: the k heaviest edges of a character, heaviest first
+ *              (equal weights by id), kept sorted by insertion.
+ * Parameters: g: the graph;
+ *             node: the id of the character;
+ *             k: how many are wanted;
+ *             ids, weights: return the neighbours and weights (room for k each).
+ * Return: the number returned, which is less than k if there are fewer neighbours.
+ */
+size_t graph_top_k(const struct character_graph *g, uint32_t node, size_t k,
+                   uint32_t *ids, double *weights)
+{
+	const uint32_t *rowIds;
+	const double *rowWeights;
+	size_t num, pos, count = 0, degree = graph_neighbours(g, node, &rowIds, &rowWeights);
+	for ( num = 0; num < degree; num++ )
+	{
+		pos = count < k ? count++ : k;
+		// Past the end means "not in the top k yet".
+		while ( pos > 0 && weights[pos - 1] < rowWeights[num] )
+		// Neighbours come by id, so a tie never moves ahead.
+		{
+			if ( pos < k )
+			{
+				ids[pos] = ids[pos - 1];
+				weights[pos] = weights[pos - 1];
+			}
+			pos--;
+		}
+		if ( pos < k )
+		{
+			ids[pos] = rowIds[num];
+			weights[pos] = rowWeights[num];
+		}
+	}
+	return count;
+}
+
+/*
+ * Function: graph_weighted_degree
+ * -------------------------------
+ * Description: the sum of the weights of the edges of every character.
+ * Parameters: g: the graph;
+ *             threadNum: the number of threads;
+ *             degree: return the degrees (room for nodeNum).
+ * Return: 0, or -1 if the threads cannot be started.
+ */
+int graph_weighted_degree(const struct character_graph *g, int threadNum, double *degree)
+{
+	struct graph_job job;
+	memset(&job, 0, sizeof(struct graph_job));
+	job.g = g;
+	job.threadNum = threadNum;
+	job.result = degree;
+	return graph_parallel(&job, degree_kernel);
+}
+
+/*
+ * Function: graph_pagerank
+ * ------------------------
+ * Description: PageRank with edges followed in proportion to their weights. The rank of
+ *              characters without edges is spread over everyone. Every node pulls from
+ *              its own row, so the threads never write to the same place.
+ * Parameters: g: the graph;
+ *             threadNum: the number of threads;
+ *             damping: the probability of following an edge, e.g. 0.85;
+ *             iterations: the most iterations to run;
+ *             tolerance: stop when the ranks change less than this in total;
+ *             rank: return the ranks, which add up to 1 (room for nodeNum).
+ * Return: 0, or -1 if memory runs out or the threads cannot be started.
+ */
+int graph_pagerank(const struct character_graph *g, int threadNum, double damping,
+                   int iterations, double tolerance, double *rank)
+{
+	struct graph_job job;
+	double *buffer;
+	uint64_t node;
+	int status;
+	if ( g -> nodeNum == 0 )
+	{
+		return 0;
+	}
+	memset(&job, 0, sizeof(struct graph_job));
+	buffer = malloc(sizeof(double) * (4 * g -> nodeNum + 2 * threadNum));
+	if ( buffer == NULL )
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	job.g = g;
+	job.threadNum = threadNum;
+	job.rank = buffer;
+	job.next = buffer + g -> nodeNum;
+	job.contrib = buffer + 2 * g -> nodeNum;
+	job.strength = buffer + 3 * g -> nodeNum;
+	job.partial = buffer + 4 * g -> nodeNum;
+	job.damping = damping;
+	job.iterations = iterations;
+	job.tolerance = tolerance;
+	status = graph_weighted_degree(g, threadNum, buffer + 3 * g -> nodeNum);
+	for ( node = 0; node < g -> nodeNum; node++ )
+	{
+		job.rank[node] = 1.0 / g -> nodeNum;
+	}
+	job.result = job.rank;
+	if ( status == 0 )
+	{
+		status = pthread_barrier_init(&job.barrier, NULL, threadNum);
+		if ( status != 0 )
+		{
+			errno = status;
+			status = -1;
+		}
+		else
+		{
+			status = graph_parallel(&job, pagerank_kernel);
+			pthread_barrier_destroy(&job.barrier);
+		}
+	}
+	if ( status == 0 )
+	{
+		memcpy(rank, job.result, sizeof(double) * g -> nodeNum);
+	}
+	free(buffer);
+	return status;
+}
+
+/*
+ * Function: graph_betweenness
+ * ---------------------------
+ * Description: betweenness centrality over shortest paths counted in edges (weights
+ *              are ignored), with Brandes' algorithm from sampleNum evenly spread
+ *              sources, scaled up to estimate all of them. It is exact when sampleNum
+ *              is at least nodeNum. Every thread takes its own sources and keeps its own
+ *              accumulator, and the accumulators are added up at the end.
+ * Parameters: g: the graph;
+ *             threadNum: the number of threads;
+ *             sampleNum: the number of sources;
+ *             centrality: return the centralities (room for nodeNum).
+ * Return: 0, or -1 if memory runs out or the threads cannot be started.
+ */
+int graph_betweenness(const struct character_graph *g, int threadNum, uint32_t sampleNum,
+                      double *centrality)
+{
+	struct graph_job job;
+	uint64_t node;
+	double scale;
+	int num, status;
+	if ( g -> nodeNum == 0 )
+	{
+		return 0;
+	}
+	memset(&job, 0, sizeof(struct graph_job));
+	job.g = g;
+	job.threadNum = threadNum;
+	job.sampleNum = sampleNum == 0 || sampleNum > g -> nodeNum ? (uint32_t) g -> nodeNum : sampleNum;
+	job.centrality = calloc(g -> nodeNum * threadNum, sizeof(double));
+	if ( job.centrality == NULL )
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	status = graph_parallel(&job, betweenness_kernel);
+	scale = (double) g -> nodeNum / job.sampleNum / 2;
+	// Every path of an undirected graph is found from both of its ends.
+	for ( node = 0; node < g -> nodeNum && status == 0; node++ )
+	{
+		centrality[node] = 0.0;
+		for ( num = 0; num < threadNum; num++ )
+		{
+			centrality[node] += job.centrality[num * g -> nodeNum + node];
+		}
+		centrality[node] *= scale;
+	}
+	free(job.centrality);
+	return status;
+}
+
+/*
+ * Function: graph_parallel
+ * ------------------------
+ * Description: run a kernel on job -> threadNum threads, each owning an even share of the nodes.
+ * Parameters: job: the work shared by the threads;
+ *             kernel: the function each thread runs on its struct graph_worker.
+ * Return: 0, or -1 if memory runs out or the threads cannot be started.
+ */
+int graph_parallel(struct graph_job *job, void *(*kernel)(void *))
+{
+	struct graph_worker *workers = malloc(sizeof(struct graph_worker) * job -> threadNum);
+	int num, status = 0;
+	if ( workers == NULL )
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	for ( num = 0; num < job -> threadNum; num++ )
+	{
+		workers[num].job = job;
+		workers[num].index = num;
+		workers[num].begin = (uint32_t) (job -> g -> nodeNum * num / job -> threadNum);
+		workers[num].end = (uint32_t) (job -> g -> nodeNum * (num + 1) / job -> threadNum);
+	}
+	for ( num = 1; num < job -> threadNum; num++ )
+	{
+		status = pthread_create(&workers[num].thread, NULL, kernel, &workers[num]);
+		if ( status != 0 )
+		{
+			// Threads waiting at a barrier would never be released, so give up at once.
+			fprintf(stderr, "pthread_create: %s\n", strerror(status));
+			exit(EXIT_FAILURE);
+		}
+	}
+	kernel(&workers[0]);
+	// The calling thread does the first share itself.
+	for ( num = 1; num < job -> threadNum; num++ )
+	{
+		pthread_join(workers[num].thread, NULL);
+	}
+	free(workers);
+	return status;
+}
+
+/*
+ * Function: degree_kernel
+ * -----------------------
+ * Description: the weighted degrees of the nodes of one thread.
+ * Parameter: arg: the struct graph_worker of the thread.
+ * Return: NULL.
+ */
+void *degree_kernel(void *arg)
+{
+	const struct graph_worker *worker = arg;
+	const struct character_graph *g = worker -> job -> g;
+	uint32_t node;
+	uint64_t pos;
+	for ( node = worker -> begin; node < worker -> end; node++ )
+	{
+		worker -> job -> result[node] = 0.0;
+		for ( pos = g -> offsets[node]; pos < g -> offsets[node + 1]; pos++ )
+		{
+			worker -> job -> result[node] += g -> weights[pos];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Function: pagerank_kernel
+ * -------------------------
+ * Description: the PageRank iterations of one thread. Each iteration has two steps
+ *              separated by barriers: the contributions of its own nodes, then their
+ *              new ranks. Every thread adds up the partial sums in the same order,
+ *              so they all agree on when to stop.
+ * Parameter: arg: the struct graph_worker of the thread.
+ * Return: NULL.
+ */
+void *pagerank_kernel(void *arg)
+{
+	const struct graph_worker *worker = arg;
+	struct graph_job *job = worker -> job;
+	const struct character_graph *g = job -> g;
+	double *rank = job -> rank, *next = job -> next, *swap, sum, base, change;
+	uint32_t node;
+	uint64_t pos;
+	int iteration, num;
+	for ( iteration = 0; iteration < job -> iterations; iteration++ )
+	{
+		sum = 0.0;
+		for ( node = worker -> begin; node < worker -> end; node++ )
+		{
+			if ( job -> strength[node] > 0.0 )
+			{
+				job -> contrib[node] = rank[node] / job -> strength[node];
+			}
+			else
+			{
+				job -> contrib[node] = 0.0;
+				sum += rank[node];
+			}
+		}
+		job -> partial[2 * worker -> index] = sum;
+		pthread_barrier_wait(&job -> barrier);
+		for ( num = 0, sum = 0.0; num < job -> threadNum; num++ )
+		{
+			sum += job -> partial[2 * num];
+		}
+		base = (1.0 - job -> damping + job -> damping * sum) / g -> nodeNum;
+		change = 0.0;
+		for ( node = worker -> begin; node < worker -> end; node++ )
+		{
+			sum = 0.0;
+			for ( pos = g -> offsets[node]; pos < g -> offsets[node + 1]; pos++ )
+			{
+				sum += job -> contrib[g -> targets[pos]] * g -> weights[pos];
+			}
+			next[node] = base + job -> damping * sum;
+			change += fabs(next[node] - rank[node]);
+		}
+		job -> partial[2 * worker -> index + 1] = change;
+		pthread_barrier_wait(&job -> barrier);
+		for ( num = 0, change = 0.0; num < job -> threadNum; num++ )
+		{
+			change += job -> partial[2 * num + 1];
+		}
+		swap = rank;
+		rank = next;
+		next = swap;
+		if ( change < job -> tolerance )
+		{
+			break;
+		}
+	}
+	if ( worker -> index == 0 )
+	{
+		job -> result = rank;
+	}
+	return NULL;
+}
+
+/*
+ * Function: betweenness_kernel
+ * ----------------------------
+ * Description: Brandes' algorithm from the sources of one thread: a breadth-first
+ *              search counting shortest paths, then the dependencies added up in
+ *              the reverse order. Predecessors are found again from the distances
+ *              rather than stored.
+ * Parameter: arg: the struct graph_worker of the thread.
+ * Return: NULL.
+ */
+void *betweenness_kernel(void *arg)
+{
+	const struct graph_worker *worker = arg;
+	const struct graph_job *job = worker -> job;
+	const struct character_graph *g = job -> g;
+	double *total = job -> centrality + worker -> index * g -> nodeNum;
+	double *sigma = malloc(sizeof(double) * g -> nodeNum * 2), *delta;
+	int64_t *dist = malloc(sizeof(int64_t) * g -> nodeNum);
+	uint32_t *order = malloc(sizeof(uint32_t) * g -> nodeNum), sample, source, node, other;
+	uint64_t head, tail, pos;
+	if ( sigma == NULL || dist == NULL || order == NULL )
+	{
+		perror("betweenness");
+		exit(EXIT_FAILURE);
+	}
+	delta = sigma + g -> nodeNum;
+	for ( sample = worker -> index; sample < job -> sampleNum; sample += job -> threadNum )
+	// Sources are dealt out in turn, which evens out the work better than ranges.
+	{
+		source = (uint32_t) ((uint64_t) sample * g -> nodeNum / job -> sampleNum);
+		for ( pos = 0; pos < g -> nodeNum; pos++ )
+		{
+			dist[pos] = -1;
+			sigma[pos] = delta[pos] = 0.0;
+		}
+		dist[source] = 0;
+		sigma[source] = 1.0;
+		order[0] = source;
+		for ( head = 0, tail = 1; head < tail; head++ )
+		// The queue is kept whole, so it is also the order to go back in.
+		{
+			node = order[head];
+			for ( pos = g -> offsets[node]; pos < g -> offsets[node + 1]; pos++ )
+			{
+				other = g -> targets[pos];
+				if ( dist[other] < 0 )
+				{
+					dist[other] = dist[node] + 1;
+					order[tail++] = other;
+				}
+				if ( dist[other] == dist[node] + 1 )
+				{
+					sigma[other] += sigma[node];
+				}
+			}
+		}
+		while ( --tail > 0 )
+		{
+			node = order[tail];
+			for ( pos = g -> offsets[node]; pos < g -> offsets[node + 1]; pos++ )
+			{
+				other = g -> targets[pos];
+				if ( dist[other] == dist[node] - 1 )
+				{
+					delta[other] += sigma[other] / sigma[node] * (1.0 + delta[node]);
+				}
+			}
+			total[node] += delta[node];
+		}
+	}
+	free(sigma);
+	free(dist);
+	free(order);
+	return NULL;
+}
+
+/*
+ * Function: graph_attach
+ * ----------------------
+ * Description: point the fields of a graph at the sections of its block.
+ * Parameter: g: the graph, whose base is set.
+ * Return: N/A.
+ */
+void graph_attach(struct character_graph *g)
+{
+	const struct graph_header *header = g -> base;
+	const char *base = g -> base;
+	g -> nodeNum = header -> nodeNum;
+	g -> entryNum = header -> entryNum;
+	g -> offsets = (const uint64_t *) (base + header -> offsetsAt);
+	g -> targets = (const uint32_t *) (base + header -> targetsAt);
+	g -> weights = (const double *) (base + header -> weightsAt);
+	g -> nameOffsets = (const uint64_t *) (base + header -> nameOffsetsAt);
+	g -> names = base + header -> namesAt;
+	g -> sortedIds = (const uint32_t *) (base + header -> sortedAt);
+}
+
+/*
+ * Function: graph_section
+ * -----------------------
+ * Description: whether a section lies inside the file, after the header, and is aligned
+ *              for its values. The sums are ordered so that nothing can overflow.
+ * Parameters: header: the header, whose size is that of the file;
+ *             at, len: where the section starts and its length in bytes;
+ *             align: the size of its values.
+ * Return: true if the section fits.
+ */
+_Bool graph_section(const struct graph_header *header, uint64_t at, uint64_t len, uint64_t align)
+{
+	return at >= sizeof(struct graph_header) && at % align == 0 && at <= header -> size
+	       && len <= header -> size - at;
+}
+
+/*
+ * Function: graph_valid
+ * ---------------------
+ * Description: check a mapped graph before any query trusts it: the sections lie in the
+ *              file, the rows are in order and end at entryNum, every neighbour and sorted
+ *              id is a node, and every name starts inside the names and ends there with a
+ *              null character. It attaches g to the sections on the way.
+ * Parameters: g: the graph, whose base is the mapping;
+ *             header: its header.
+ * Return: true if the graph can be queried safely.
+ */
+_Bool graph_valid(struct character_graph *g, const struct graph_header *header)
+{
+	uint64_t num;
+	if ( header -> nodeNum >= UINT32_MAX || header -> nodeNum > header -> size / sizeof(uint64_t)
+	     || header -> entryNum > header -> size / sizeof(uint64_t)
+	     || !graph_section(header, header -> offsetsAt, (header -> nodeNum + 1) * sizeof(uint64_t), sizeof(uint64_t))
+	     || !graph_section(header, header -> targetsAt, header -> entryNum * sizeof(uint32_t), sizeof(uint32_t))
+	     || !graph_section(header, header -> weightsAt, header -> entryNum * sizeof(double), sizeof(double))
+	     || !graph_section(header, header -> nameOffsetsAt, (header -> nodeNum + 1) * sizeof(uint64_t),
+	                       sizeof(uint64_t))
+	     || !graph_section(header, header -> namesAt, header -> nameBytes, 1)
+	     || !graph_section(header, header -> sortedAt, header -> nodeNum * sizeof(uint32_t), sizeof(uint32_t)) )
+	{
+		return false;
+	}
+	graph_attach(g);
+	if ( g -> offsets[0] != 0 || g -> offsets[g -> nodeNum] != g -> entryNum
+	     || g -> nameOffsets[g -> nodeNum] != header -> nameBytes
+	     || (header -> nameBytes && g -> names[header -> nameBytes - 1] != '\0') )
+	{
+		return false;
+	}
+	for ( num = 0; num < g -> nodeNum; num++ )
+	{
+		if ( g -> offsets[num] > g -> offsets[num + 1] || g -> nameOffsets[num] >= header -> nameBytes
+		     || g -> sortedIds[num] >= g -> nodeNum )
+		{
+			return false;
+		}
+	}
+	for ( num = 0; num < g -> entryNum; num++ )
+	{
+		if ( g -> targets[num] >= g -> nodeNum )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Function: compare_entries
+ * -------------------------
+ * Description: order entries by source, then target, used by qsort().
+ * Parameters: a, b: the entries to be compared.
+ * Return: negative, zero or positive as a is before, equal to or after b.
+ */
+int compare_entries(const void *a, const void *b)
+{
+	const struct graph_entry *x = a, *y = b;
+	if ( x -> source != y -> source )
+	{
+		return x -> source < y -> source ? -1 : 1;
+	}
+	return (x -> target > y -> target) - (x -> target < y -> target);
+}
+
+/*
+ * Function: compare_names
+ * -----------------------
+ * Description: order names alphabetically, then by id, used by qsort().
+ * Parameters: a, b: the names to be compared.
+ * Return: negative, zero or positive as a is before, equal to or after b.
+ */
+int compare_names(const void *a, const void *b)
+{
+	const struct graph_name *x = a, *y = b;
+	int order = strcmp(x -> name, y -> name);
+	if ( order != 0 )
+	{
+		return order;
+	}
+	return (x -> id > y -> id) - (x -> id < y -> id);
+}
@@ -0,0 +1,84 @@
+/*
+ *  Created on: Oct 15, 2026
+ *     Version: v1.0-1015
+ * Description: A co-occurrence graph of characters in compressed sparse row (CSR) form.
+ *              The whole graph lives in one block laid out exactly like the file,
+ *              so writing it is a single fwrite() and opening it is a single mmap().
+ *              Every edge is stored in both directions; the neighbours of a character
+ *              are sorted by id. Ids are the positions of the names in the name list.
+ *              The file is written in the byte order of the machine.
+ *              The analytics kernels (weighted degree, PageRank and betweenness) work on
+ *              the same layout and split their work over POSIX threads.
+ */
+
+#ifndef CHARACTER_GRAPH_H
+#define CHARACTER_GRAPH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GRAPH_MAGIC "CHARGRF1"
+
+// The beginning of a graph file. Every section starts at a multiple of 8 bytes.
+struct graph_header
+{
+	char magic[8];
+	uint64_t nodeNum;
+	uint64_t entryNum;
+	// Twice the number of edges.
+	uint64_t nameBytes;
+	uint64_t offsetsAt;
+	uint64_t targetsAt;
+	uint64_t weightsAt;
+	uint64_t nameOffsetsAt;
+	uint64_t namesAt;
+	uint64_t sortedAt;
+	uint64_t size;
+	// The size of the whole file.
+};
+
+struct character_graph
+{
+	void *base;
+	// The block holding the file, either malloc()ed or mapped.
+	_Bool mapped;
+	uint64_t nodeNum;
+	uint64_t entryNum;
+	const uint64_t *offsets;
+	// The neighbours of node n are targets[offsets[n]] to targets[offsets[n + 1] - 1].
+	const uint32_t *targets;
+	const double *weights;
+	const uint64_t *nameOffsets;
+	const char *names;
+	const uint32_t *sortedIds;
+	// Node ids sorted by name, for binary search.
+};
+
+// An undirected edge given to graph_build().
+struct graph_edge
+{
+	uint32_t first;
+	uint32_t second;
+	double weight;
+};
+
+// Function declarations. Functions returning int give 0 on success and -1 (with errno) on failure.
+int graph_build(struct character_graph *g, uint32_t nodeNum, const char * const *names,
+                size_t edgeNum, const struct graph_edge *edges);
+int graph_write(const struct character_graph *g, const char *path);
+int graph_open(struct character_graph *g, const char *path);
+void graph_close(struct character_graph *g);
+const char *graph_name(const struct character_graph *g, uint32_t node);
+long graph_find(const struct character_graph *g, const char *name);
+size_t graph_neighbours(const struct character_graph *g, uint32_t node,
+                        const uint32_t **ids, const double **weights);
+double graph_weight(const struct character_graph *g, uint32_t first, uint32_t second);
+size_t graph_top_k(const struct character_graph *g, uint32_t node, size_t k,
+                   uint32_t *ids, double *weights);
+int graph_weighted_degree(const struct character_graph *g, int threadNum, double *degree);
+int graph_pagerank(const struct character_graph *g, int threadNum, double damping,
+                   int iterations, double tolerance, double *rank);
+int graph_betweenness(const struct character_graph *g, int threadNum, uint32_t sampleNum,
+                      double *centrality);
+
+#endif
@@ -0,0 +1,540 @@
+/*
+ *  Created on: Oct 15, 2026
+ *     Version: v1.0-1015
+ * Description: The buffered writer declared in CsvWriter.h and its gzip stream.
+ *              The deflater looks for matches through hash chains over the last 32 KiB
+ *              and writes every block with the fixed Huffman codes of RFC 1951, so it
+ *              needs no code tables of its own. It is greedy and keeps only GZIP_CHAIN
+ *              candidates per position: the files come out somewhat bigger than from
+ *              gzip -6, which matters little for rows made of a few hundred names.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include "CsvWriter.h"
+
+#define GZIP_WINDOW 32768
+// The farthest a match may reach back, the most RFC 1951 allows.
+#define GZIP_BLOCK (256 << 10)
+// The number of new bytes compressed into each deflate block.
+#define GZIP_HASH_BITS 15
+#define GZIP_CHAIN 32
+// The most earlier positions tried for a match.
+#define GZIP_MIN_MATCH 3
+#define GZIP_MAX_MATCH 258
+#define GZIP_OUTPUT ((GZIP_WINDOW + GZIP_BLOCK) / 8 * 11 + 64)
+// A literal takes at most 9 bits and a match of 3 bytes at most 31, so 11 bits a byte will do.
+#define GZIP_HEADER "\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03"
+// Deflate, no name, no time, Unix.
+#define GZIP_HEADER_SIZE 10
+#define END_OF_BLOCK 256
+#define FIXED_BLOCK 1
+
+// The bases and extra bits of the length codes 257 to 285 and the distance codes 0 to 29.
+static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                         35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                               3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                           257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                           8193, 12289, 16385, 24577 };
+static const unsigned char distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                                 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+/*
+ * A gzip member being written. data holds up to GZIP_WINDOW bytes already compressed,
+ * which later matches may refer to, followed by the bytes waiting for the next block.
+ * The tables are kept per stream, so that writers on different threads share nothing.
+ */
+struct gzip_stream
+{
+	FILE *fp;
+	unsigned char *data;
+	size_t history;
+	size_t len;
+	int *head;
+	// The last position with each hash, or -1.
+	int *prev;
+	// The position before each one with the same hash, or -1.
+	uint32_t crc;
+	uint32_t size;
+	// The length of the input modulo 2^32.
+	uint64_t bits;
+	int bitNum;
+	unsigned char *out;
+	size_t outLen;
+	uint32_t crcTable[256];
+	uint16_t literalCode[288];
+	// The fixed codes, bit-reversed because deflate sends them from the top bit.
+	unsigned char literalLen[288];
+	uint16_t distanceCode[30];
+	unsigned char lengthSymbol[GZIP_MAX_MATCH + 1];
+	// The length code of each match length, minus 257.
+};
+
+// Function declarations.
+struct gzip_stream *gzip_open(FILE *fp);
+int gzip_write(struct gzip_stream *gz, const char *bytes, size_t len);
+int gzip_block(struct gzip_stream *gz, _Bool final);
+int gzip_close(struct gzip_stream *gz);
+void gzip_bits(struct gzip_stream *gz, uint32_t value, int num);
+void gzip_match(struct gzip_stream *gz, size_t length, size_t distance);
+uint16_t reverse_bits(uint16_t code, int num);
+void writer_emit(struct csv_writer *w, const char *bytes, size_t len);
+
+/*
+ * Function: writer_open
+ * ---------------------
+ * Description: start writing rows to a stream.
+ * Parameters: w: return the writer;
+ *             fp: the stream, which stays open after writer_close();
+ *             names, nameNum: the names rows are made of, measured here once;
+ *             compress: whether to write a gzip stream.
+ * Return: 0, or -1 if there is not enough memory.
+ */
+int writer_open(struct csv_writer *w, FILE *fp, const char * const *names, int nameNum, _Bool compress)
+{
+	int num;
+	w -> fp = fp;
+	w -> len = 0;
+	w -> nameNum = nameNum;
+	w -> error = 0;
+	w -> gz = NULL;
+	w -> buffer = malloc(WRITER_BUFFER);
+	w -> names = malloc(sizeof(char *) * (nameNum + 1));
+	w -> nameLens = malloc(sizeof(size_t) * (nameNum + 1));
+	if ( w -> buffer == NULL || w -> names == NULL || w -> nameLens == NULL
+	     || (compress && (w -> gz = gzip_open(fp)) == NULL) )
+	{
+		free(w -> buffer);
+		free(w -> names);
+		free(w -> nameLens);
+		return -1;
+	}
+	for ( num = 0; num < nameNum; num++ )
+	{
+		w -> names[num] = names[num];
+		w -> nameLens[num] = strlen(names[num]);
+	}
+	return 0;
+}
+
+/*
+ * Function: writer_spill
+ * ----------------------
+ * Description: the slow path of writer_put(): flush the buffer, then take the bytes,
+ *              or write them straight through if they would not fit in it anyway.
+ * Parameters: w: the writer;
+ *             bytes, len: what to append.
+ * Return: N/A.
+ */
+void writer_spill(struct csv_writer *w, const char *bytes, size_t len)
+{
+	writer_flush(w);
+	if ( len >= WRITER_BUFFER )
+	{
+		writer_emit(w, bytes, len);
+		return;
+	}
+	memcpy(w -> buffer, bytes, len);
+	w -> len = len;
+}
+
+/*
+ * Function: writer_number
+ * -----------------------
+ * Description: append a number in decimal, as "%llu" would.
+ * Parameters: w: the writer;
+ *             value: the number.
+ * Return: N/A.
+ */
+void writer_number(struct csv_writer *w, uint64_t value)
+{
+	char digits[20];
+	int pos = sizeof(digits);
+	do
+	{
+		digits[--pos] = '0' + value % 10;
+		value /= 10;
+	} while ( value );
+	writer_put(w, digits + pos, sizeof(digits) - pos);
+}
+
+/*
+ * Function: writer_flush
+ * ----------------------
+ * Description: pass the buffer on to the stream (or the deflater, which holds
+ *              back the bytes of a block until it is full).
+ * Parameter: w: the writer.
+ * Return: 0, or -1 if a write has failed.
+ */
+int writer_flush(struct csv_writer *w)
+{
+	writer_emit(w, w -> buffer, w -> len);
+	w -> len = 0;
+	if ( w -> error )
+	{
+		errno = w -> error;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Function: writer_close
+ * ----------------------
+ * Description: flush the buffer, end the gzip stream and release the writer.
+ *              The stream itself is neither flushed nor closed.
+ * Parameter: w: the writer.
+ * Return: 0, or -1 if any write has failed.
+ */
+int writer_close(struct csv_writer *w)
+{
+	writer_flush(w);
+	if ( w -> gz && gzip_close(w -> gz) == -1 && w -> error == 0 )
+	{
+		w -> error = errno ? errno : EIO;
+	}
+	free(w -> buffer);
+	free(w -> names);
+	free(w -> nameLens);
+	w -> buffer = NULL;
+	w -> gz = NULL;
+	if ( w -> error )
+	{
+		errno = w -> error;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Function: writer_emit
+ * ---------------------
+ * Description: write bytes to the stream or the deflater, unless a write has failed before.
+ * Parameters: w: the writer;
+ *             bytes, len: what to write.
+ * Return: N/A.
+ */
+void writer_emit(struct csv_writer *w, const char *bytes, size_t len)
+{
+	if ( w -> error || len == 0 )
+	{
+		return;
+	}
+	errno = 0;
+	if ( w -> gz ? gzip_write(w -> gz, bytes, len) == -1 : fwrite(bytes, 1, len, w -> fp) != len )
+	{
+		w -> error = errno ? errno : EIO;
+	}
+}
+
+/*
+ * Function: gzip_open
+ * -------------------
+ * Description: start a gzip member and fill in the code tables.
+ * Parameter: fp: where the member goes.
+ * Return: the stream, or NULL if there is not enough memory.
+ */
+struct gzip_stream *gzip_open(FILE *fp)
+{
+	int num, bit, symbol;
+	uint32_t crc;
+	struct gzip_stream *gz = malloc(sizeof(struct gzip_stream));
+	if ( gz == NULL )
+	{
+		return NULL;
+	}
+	gz -> data = malloc(GZIP_WINDOW + GZIP_BLOCK);
+	gz -> head = malloc(sizeof(int) << GZIP_HASH_BITS);
+	gz -> prev = malloc(sizeof(int) * (GZIP_WINDOW + GZIP_BLOCK));
+	gz -> out = malloc(GZIP_OUTPUT);
+	if ( gz -> data == NULL || gz -> head == NULL || gz -> prev == NULL || gz -> out == NULL )
+	{
+		free(gz -> data);
+		free(gz -> head);
+		free(gz -> prev);
+		free(gz -> out);
+		free(gz);
+		return NULL;
+	}
+	gz -> fp = fp;
+	gz -> history = gz -> len = 0;
+	gz -> crc = 0xffffffff;
+	gz -> size = 0;
+	gz -> bits = 0;
+	gz -> bitNum = 0;
+	for ( num = 0; num < 256; num++ )
+	{
+		for ( crc = num, bit = 0; bit < 8; bit++ )
+		{
+			crc = crc & 1 ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+		}
+		gz -> crcTable[num] = crc;
+	}
+	for ( num = 0; num < 288; num++ )
+	// The fixed literal/length codes of RFC 1951, 3.2.6.
+	{
+		if ( num < 144 )
+		{
+			gz -> literalCode[num] = reverse_bits(0x30 + num, 8);
+			gz -> literalLen[num] = 8;
+		}
+		else if ( num < 256 )
+		{
+			gz -> literalCode[num] = reverse_bits(0x190 + num - 144, 9);
+			gz -> literalLen[num] = 9;
+		}
+		else if ( num < 280 )
+		{
+			gz -> literalCode[num] = reverse_bits(num - 256, 7);
+			gz -> literalLen[num] = 7;
+		}
+		else
+		{
+			gz -> literalCode[num] = reverse_bits(0xc0 + num - 280, 8);
+			gz -> literalLen[num] = 8;
+		}
+	}
+	for ( num = 0; num < 30; num++ )
+	{
+		gz -> distanceCode[num] = reverse_bits(num, 5);
+	}
+	for ( symbol = 0, num = GZIP_MIN_MATCH; num <= GZIP_MAX_MATCH; num++ )
+	{
+		while ( symbol < 28 && lengthBase[symbol + 1] <= num )
+		{
+			symbol++;
+		}
+		gz -> lengthSymbol[num] = symbol;
+	}
+	memcpy(gz -> out, GZIP_HEADER, GZIP_HEADER_SIZE);
+	gz -> outLen = GZIP_HEADER_SIZE;
+	// It goes out with the first block.
+	return gz;
+}
+
+/*
+ * Function: gzip_write
+ * --------------------
+ * Description: add bytes to the stream, compressing a block whenever enough are waiting.
+ * Parameters: gz: the stream;
+ *             bytes, len: what to add.
+ * Return: 0, or -1 if the compressed data cannot be written.
+ */
+int gzip_write(struct gzip_stream *gz, const char *bytes, size_t len)
+{
+	size_t pos, room;
+	uint32_t crc = gz -> crc;
+	for ( pos = 0; pos < len; pos++ )
+	{
+		crc = gz -> crcTable[(crc ^ (unsigned char) bytes[pos]) & 0xff] ^ (crc >> 8);
+	}
+	gz -> crc = crc;
+	gz -> size += (uint32_t) len;
+	while ( len > 0 )
+	{
+		room = GZIP_WINDOW + GZIP_BLOCK - gz -> len;
+		if ( room > len )
+		{
+			room = len;
+		}
+		memcpy(gz -> data + gz -> len, bytes, room);
+		gz -> len += room;
+		bytes += room;
+		len -= room;
+		if ( gz -> len == GZIP_WINDOW + GZIP_BLOCK && gzip_block(gz, false) == -1 )
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Function: gzip_block
+ * --------------------
+ * Description: compress the waiting bytes into one fixed-code block and write it out,
+ *              then keep the last GZIP_WINDOW bytes for the matches of the next one.
+ *              The chains are rebuilt over the kept bytes, so positions never wrap.
+ * Parameters: gz: the stream;
+ *             final: whether this is the last block of the member.
+ * Return: 0, or -1 if the block cannot be written.
+ */
+int gzip_block(struct gzip_stream *gz, _Bool final)
+{
+	const unsigned char *data = gz -> data;
+	size_t pos, end = gz -> len, best, length, limit, distance = 0, keep;
+	int cand, chain, *head = gz -> head, *prev = gz -> prev;
+	unsigned hash;
+	memset(head, -1, sizeof(int) << GZIP_HASH_BITS);
+	gzip_bits(gz, final, 1);
+	gzip_bits(gz, FIXED_BLOCK, 2);
+	for ( pos = 0; pos < end; )
+	{
+		if ( pos + GZIP_MIN_MATCH > end )
+		{
+			gzip_bits(gz, gz -> literalCode[data[pos]], gz -> literalLen[data[pos]]);
+			pos++;
+			continue;
+		}
+		hash = ((data[pos] << 10) ^ (data[pos + 1] << 5) ^ data[pos + 2]) & ((1 << GZIP_HASH_BITS) - 1);
+		cand = head[hash];
+		prev[pos] = cand;
+		head[hash] = (int) pos;
+		if ( pos < gz -> history )
+		// Only filling the chains.
+		{
+			pos++;
+			continue;
+		}
+		best = 0;
+		limit = end - pos < GZIP_MAX_MATCH ? end - pos : GZIP_MAX_MATCH;
+		for ( chain = GZIP_CHAIN; cand >= 0 && chain > 0 && pos - cand <= GZIP_WINDOW; chain--, cand = prev[cand] )
+		{
+			if ( data[cand + best] != data[pos + best] )
+			// It cannot be longer than the best so far.
+			{
+				continue;
+			}
+			for ( length = 0; length < limit && data[cand + length] == data[pos + length]; length++ )
+			{
+				;
+			}
+			if ( length > best )
+			{
+				best = length;
+				distance = pos - cand;
+				if ( best == limit )
+				{
+					break;
+				}
+			}
+		}
+		if ( best < GZIP_MIN_MATCH )
+		{
+			gzip_bits(gz, gz -> literalCode[data[pos]], gz -> literalLen[data[pos]]);
+			pos++;
+			continue;
+		}
+		gzip_match(gz, best, distance);
+		for ( length = 1; length < best && pos + length + GZIP_MIN_MATCH <= end; length++ )
+		{
+			hash = ((data[pos + length] << 10) ^ (data[pos + length + 1] << 5) ^ data[pos + length + 2])
+			       & ((1 << GZIP_HASH_BITS) - 1);
+			prev[pos + length] = head[hash];
+			head[hash] = (int) (pos + length);
+		}
+		pos += best;
+	}
+	gzip_bits(gz, gz -> literalCode[END_OF_BLOCK], gz -> literalLen[END_OF_BLOCK]);
+	keep = end < GZIP_WINDOW ? end : GZIP_WINDOW;
+	memmove(gz -> data, gz -> data + end - keep, keep);
+	gz -> history = gz -> len = keep;
+	if ( fwrite(gz -> out, 1, gz -> outLen, gz -> fp) != gz -> outLen )
+	{
+		return -1;
+	}
+	gz -> outLen = 0;
+	return 0;
+}
+
+/*
+ * Function: gzip_close
+ * --------------------
+ * Description: compress what is left as the final block, write the trailer
+ *              and release the stream.
+ * Parameter: gz: the stream.
+ * Return: 0, or -1 if the end of the member cannot be written.
+ */
+int gzip_close(struct gzip_stream *gz)
+{
+	int num, result = gzip_block(gz, true);
+	if ( gz -> bitNum > 0 )
+	// The trailer starts on a byte boundary.
+	{
+		gzip_bits(gz, 0, 8 - gz -> bitNum);
+	}
+	for ( num = 0; num < 4; num++ )
+	{
+		gz -> out[gz -> outLen++] = (~gz -> crc >> (8 * num)) & 0xff;
+	}
+	for ( num = 0; num < 4; num++ )
+	{
+		gz -> out[gz -> outLen++] = (gz -> size >> (8 * num)) & 0xff;
+	}
+	if ( result == 0 && fwrite(gz -> out, 1, gz -> outLen, gz -> fp) != gz -> outLen )
+	{
+		result = -1;
+	}
+	free(gz -> data);
+	free(gz -> head);
+	free(gz -> prev);
+	free(gz -> out);
+	free(gz);
+	return result;
+}
+
+/*
+ * Function: gzip_bits
+ * -------------------
+ * Description: send bits, lowest first, moving whole bytes to the output buffer.
+ * Parameters: gz: the stream;
+ *             value, num: the bits and how many of them there are (at most 16).
+ * Return: N/A.
+ */
+void gzip_bits(struct gzip_stream *gz, uint32_t value, int num)
+{
+	gz -> bits |= (uint64_t) value << gz -> bitNum;
+	gz -> bitNum += num;
+	while ( gz -> bitNum >= 8 )
+	{
+		gz -> out[gz -> outLen++] = gz -> bits & 0xff;
+		gz -> bits >>= 8;
+		gz -> bitNum -= 8;
+	}
+}
+
+/*
+ * Function: gzip_match
+ * --------------------
+ * Description: send a match as its length code, distance code and their extra bits.
+ * Parameters: gz: the stream;
+ *             length: from GZIP_MIN_MATCH to GZIP_MAX_MATCH;
+ *             distance: from 1 to GZIP_WINDOW.
+ * Return: N/A.
+ */
+void gzip_match(struct gzip_stream *gz, size_t length, size_t distance)
+{
+	int symbol = gz -> lengthSymbol[length], code = 29;
+	gzip_bits(gz, gz -> literalCode[257 + symbol], gz -> literalLen[257 + symbol]);
+	gzip_bits(gz, length - lengthBase[symbol], lengthExtra[symbol]);
+	while ( distanceBase[code] > distance )
+	{
+		code--;
+	}
+	gzip_bits(gz, gz -> distanceCode[code], 5);
+	gzip_bits(gz, distance - distanceBase[code], distanceExtra[code]);
+}
+
+/*
+ * Function: reverse_bits
+ * ----------------------
+ * Description: reverse the order of the lowest bits of a code.
+ * Parameters: code: the code;
+ *             num: the number of bits in it.
+ * Return: the reversed code.
+ */
+uint16_t reverse_bits(uint16_t code, int num)
+{
+	uint16_t result = 0;
+	int bit;
+	for ( bit = 0; bit < num; bit++ )
+	{
+		result = (result << 1) | ((code >> bit) & 1);
+	}
+	return result;
+}
@@ -0,0 +1,78 @@
+/*
+ *  Created on: Oct 15, 2026
+ *     Version: v1.0-1015
+ * Description: A buffered writer for the rows of SocialNetwork. The names are given once,
+ *              with their lengths, and a row is put together by copying their bytes and
+ *              the separators into a large buffer, which goes to the stream in blocks of
+ *              WRITER_BUFFER bytes. No row goes through printf().
+ *              The output can also be compressed on its way out into a gzip stream
+ *              (RFC 1951 and 1952) by the small deflater in CsvWriter.c, which needs no
+ *              library. Appending to a gzip file adds a member, which gzip reads as well.
+ */
+
+#ifndef CSV_WRITER_H
+#define CSV_WRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define WRITER_BUFFER (1 << 20)
+
+struct gzip_stream;
+
+struct csv_writer
+{
+	FILE *fp;
+	char *buffer;
+	size_t len;
+	// The bytes held in buffer.
+	const char **names;
+	size_t *nameLens;
+	int nameNum;
+	struct gzip_stream *gz;
+	// NULL unless the output is compressed.
+	int error;
+	// The errno of the first failed write, or 0.
+};
+
+// Function declarations. Functions returning int give 0 on success and -1 (with errno) on failure.
+int writer_open(struct csv_writer *w, FILE *fp, const char * const *names, int nameNum, _Bool compress);
+void writer_spill(struct csv_writer *w, const char *bytes, size_t len);
+void writer_number(struct csv_writer *w, uint64_t value);
+int writer_flush(struct csv_writer *w);
+int writer_close(struct csv_writer *w);
+
+/*
+ * Function: writer_put
+ * --------------------
+ * Description: append bytes to the buffer, flushing it first if they do not fit.
+ * Parameters: w: the writer;
+ *             bytes, len: what to append.
+ * Return: N/A. A failure is kept in w -> error and returned by writer_close().
+ */
+static inline void writer_put(struct csv_writer *w, const char *bytes, size_t len)
+{
+	if ( len > WRITER_BUFFER - w -> len )
+	{
+		writer_spill(w, bytes, len);
+		return;
+	}
+	memcpy(w -> buffer + w -> len, bytes, len);
+	w -> len += len;
+}
+
+/*
+ * Function: writer_name
+ * ---------------------
+ * Description: append the name with the given id.
+ * Parameters: w: the writer;
+ *             id: the position of the name in the list given to writer_open().
+ * Return: N/A.
+ */
+static inline void writer_name(struct csv_writer *w, int id)
+{
+	writer_put(w, w -> names[id], w -> nameLens[id]);
+}
+
+#endif
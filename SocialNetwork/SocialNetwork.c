@@ -4,12 +4,52 @@
  *     Version: v1.0-0501
  * Description: Create a command line version of extracting social networks
  *              from text of Les Miserables written by Victor Hugo.
+ *       Build: gcc -std=c99 -pthread -o SocialNetwork SocialNetwork.c CharacterGraph.c CsvWriter.c -lm
+ *       Usage: SocialNetwork [-i text] [-n names] [-o output] [-w lines] [-t threads]
+ *                            [-s legacy|stream|weighted] [-S] [-u state] [-c] [-b] [-g graph]
+ *                            [-a analytics] [-U line|sentence|paragraph] [-d decay] [-m manifest] [-p]
+ *                            [-z] [-q name[,name]]
+ *              The defaults are the macros below; "-" stands for stdin or stdout, e.g.
+ *              zcat corpus.txt.gz | SocialNetwork -S -i - -o - -s weighted
+ *              -S writes stream rows unless -s says otherwise; it refuses -s legacy,
+ *              which would have to hold every row until the end.
+ *              With -u only text appended since the last run with the same state file is read.
+ *              -c ignores case (ASCII letters) and -b only accepts names between word boundaries.
+ *              A name in the list may be followed by aliases, e.g. "Valjean|Madeleine|Fauchelevent".
+ *              -g also saves the weighted graph as a binary CSR file which other programs
+ *              can map and query through CharacterGraph.h.
+ *              -q queries the graph file of -g without reading any text: one name gives
+ *              its neighbours, heaviest first, and two names the weight between them,
+ *              as "name1,name2,weight" rows (printed as -s weighted would with the same -d).
+ *              -a ranks the characters by PageRank and writes their weighted degree,
+ *              PageRank and betweenness, computed on -t threads.
+ *              -U measures the window in sentences or paragraphs instead of lines, and
+ *              -d weights every co-occurrence by decay to the power of its distance;
+ *              a decay which underflows to 0 within the window is refused.
+ *              -m reads a list of books, one per line ("text [output]"), scans them on
+ *              -t threads and writes the merged weighted edges of all of them to -o.
+ *              -p prints counters and the time spent in each phase to stderr as JSON.
+ *              -z compresses the rows (-o and the books of -m) into gzip streams.
+ *              Define SOCIAL_NETWORK_LIBRARY to include this file without main()
+ *              (see SocialNetworkBench.c).
  */
 
+#define _POSIX_C_SOURCE 200809L
+// Define it in order to use POSIX threads, mmap() and clock_gettime().
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <ctype.h>
+#include <float.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "CharacterGraph.h"
+#include "CsvWriter.h"
 
 #define RELEASE
 #ifdef RELEASE
@@ -29,251 +69,3152 @@
 #define INPUT_MODE "r"
 
 #define OUTPUT_FILE "./Les-Mis-Co-Occurrence.csv"
-#define CSV_FORMAT "%s, %s\n"
+#define CSV_SEPARATOR ", "
+// Rows are "name1, name2".
+#define EDGE_SEPARATOR ","
+// Edges are "name1,name2,weight".
+#define DECAYED_WEIGHT_FORMAT "%.6f"
+// Weights are whole numbers unless they decay.
+#define ANALYTICS_HEADER "name,weighted_degree,pagerank,betweenness\n"
+#define ANALYTICS_FORMAT "%s,%.0f,%.8f,%.2f\n"
+#define QUERY_SEPARATOR ','
+// Between the two names of -q.
 #define OUTPUT_MODE "w"
 
+enum outputStyle { LEGACY_ROWS, STREAM_ROWS, WEIGHTED_EDGES };
+/*
+ * LEGACY_ROWS: one row per co-occurring pair of occurrences, in the same order as
+ *              the old all-pairs loop (sorted by name, then by occurrence).
+ * STREAM_ROWS: the same rows, written in line order as soon as they are found.
+ * WEIGHTED_EDGES: one "name1,name2,weight" row per pair of names, where weight is
+ *                 the number of rows the other two styles would write for it.
+ */
+#define OUTPUT_STYLE LEGACY_ROWS
+
+enum windowUnit { LINE_UNITS, SENTENCE_UNITS, PARAGRAPH_UNITS };
+/*
+ * What the window is measured in. The units are counted while the text is scanned.
+ * SENTENCE_UNITS: a sentence ends at '.', '!' or '?' (or at a blank line) and
+ *                 the next one starts at the next letter or digit.
+ * PARAGRAPH_UNITS: paragraphs are separated by blank lines (lines without letters or digits).
+ */
+#define WINDOW_UNIT LINE_UNITS
+#define SENTENCE_END ".!?"
+#define EDGE_DECAY 1.0
+// Each co-occurrence adds EDGE_DECAY to the power of its distance in units to the edge.
+
 #define BUFFER_SIZE 256
 #define NFIELD 1
 
 #define CO_OCCURRENCE 5
 // Two names occurring within five lines of each other counts as a co-occurrence.
+#define STDIO_PATH "-"
+#define OPTION_STRING "i:n:o:w:t:s:Su:cbg:a:U:d:m:pzq:h"
+#define ALIAS_SEPARATOR '|'
+#define APPEND_MODE "a"
+#define STATE_MAGIC "SNSTATE5"
+#define STATE_SUFFIX ".tmp"
+#define STATE_SAMPLE 65536
+// The bytes at each end of the text read so far which identify it in the state file.
+#define BOOK_SUFFIX "-Co-Occurrence.csv"
+
+#define ALPHABET_SIZE 256
+#define INITIAL_STATES 64
+#define INITIAL_EVENTS 64
+#define INITIAL_LINES 16
+#define INITIAL_NAME_BYTES 4096
+#define INITIAL_NAME_SLOTS 16
+// Must be a power of two.
+#define NAME_ALIGN 16
+// Where the characters start after the text of the list.
+
+#define SCAN_THREADS 1
+// Set it above 1 to scan the novel in line-aligned chunks on that many threads.
+#define CHUNK_SIZE (4 << 20)
+// The number of bytes each thread scans at a time.
+// The novel is mapped into memory when possible and read through stdio otherwise (e.g. a pipe).
+#define INITIAL_EDGES 1024
+// Must be a power of two.
+
+#define PAGERANK_DAMPING 0.85
+#define PAGERANK_ITERATIONS 100
+#define PAGERANK_TOLERANCE 1e-10
+#define BETWEENNESS_SAMPLES 256
+// Betweenness is estimated from this many sources; it is exact for shorter name lists.
+
+enum statsPhase { READ_PHASE, COMPILE_PHASE, SCAN_PHASE, SWEEP_PHASE, OUTPUT_PHASE, GRAPH_PHASE,
+                  TOTAL_PHASE, PHASE_NUM };
+/*
+ * READ_PHASE: read_names. COMPILE_PHASE: build_automaton.
+ * SCAN_PHASE: reading the text and finding names (with -S, the sweep line as well).
+ * SWEEP_PHASE: pairing occurrences. OUTPUT_PHASE: writing rows and the state file.
+ * GRAPH_PHASE: -g and -a. TOTAL_PHASE: the whole run.
+ */
+#define PHASE_NAMES { "read_names", "build_automaton", "scan", "sweep", "output", "graph", "total" }
+
+/*
+ * Counters and timers for -p. They are only touched when -p is given, and then mostly
+ * once per chunk, event or flush rather than once per byte. In the batch mode every
+ * thread keeps its own and adds them up at the end, so phase times are summed over threads.
+ */
+struct run_stats
+{
+	unsigned long long lines;
+	unsigned long long bytes;
+	unsigned long long matches;
+	unsigned long long lineAllocs;
+	// How many times a line list was allocated or grown.
+	unsigned long long comparisons;
+	// Occurrences looked at by the sweep line.
+	unsigned long long pairs;
+	unsigned long long rows;
+	long long ns[PHASE_NUM];
+};
 
 struct character
 {
 	char *name;
-	struct line
-	{
-		int lineNo;
-		struct line *next;
-	} *lineList;
-	// A linked list containing line numbers for each name.
+	char **aliases;
+	// Other spellings of the same character, which share the storage of name.
+	int aliasNum;
+	int *lineList;
+	// A growable array containing line numbers for each name, sorted by construction.
+	size_t lineNum;
+	size_t lineCap;
+};
+
+/*
+ * The character list in a single block: the text of the list cut into names and
+ * aliases, then the characters in list order, their alias pointers and a hash table
+ * from names to ids, which interns the names while the list is read. The id of a
+ * character is the position of the first entry of its name among the different names.
+ */
+struct name_table
+{
+	char *block;
+	struct character *chars;
+	int nameNum;
+	int *slots;
+	// An open-addressing hash table holding id + 1, or 0 for an empty slot.
+	size_t slotCap;
+	// Must be a power of two.
+};
+
+/*
+ * An Aho-Corasick automaton built once from the whole name list,
+ * so that the novel is parsed only once no matter how many names there are.
+ */
+struct automaton
+{
+	int nameNum;
+	int patternNum;
+	// Names and aliases together.
+	_Bool foldCase;
+	_Bool wordBoundary;
+	unsigned char wordChar[ALPHABET_SIZE];
+	// Letters, digits, '_' and every byte of a UTF-8 sequence are parts of words.
+	enum windowUnit unit;
+	unsigned char sentenceEnd[ALPHABET_SIZE];
+	int stateNum;
+	int stateCap;
+	int classNum;
+	unsigned char byteClass[ALPHABET_SIZE];
+	// Bytes which never occur in any name share class 0, which keeps the table narrow.
+	int *next;
+	// The transition table: next[state * classNum + class].
+	int *fail;
+	int *output;
+	// The first pattern ending at each state, or -1 if there is none.
+	int *dictLink;
+	// The nearest proper suffix state (through fail links) which ends a pattern, or 0.
+	int *sameOutput;
+	// The next pattern ending at the same state (only when the list contains duplicates).
+	int *patternName;
+	// The name each pattern belongs to.
+	size_t *patternLen;
+};
+
+// One occurrence of a name in the line-sorted event stream.
+struct event
+{
+	int lineNo;
+	// With -U, the number of the sentence or paragraph instead; so are line lists.
+	int nameNo;
+	int occurNo;
+	// The position of this occurrence in the line list of its name.
+};
+
+// A growable list of events found by a scanner.
+struct event_list
+{
+	struct event *events;
+	size_t num;
+	size_t cap;
+};
+
+/*
+ * Where the scanner is in sentences or paragraphs. A boundary only makes a new unit
+ * when the next word starts, so blank lines and "..." never make empty units.
+ */
+struct unit_state
+{
+	int unit;
+	_Bool pending;
+	// A boundary has been passed since the last word.
+	_Bool opened;
+	// A word has been seen in unit 0, i.e. before the first boundary of a chunk.
+};
+
+// The work of one thread in the parallel scan.
+struct scan_task
+{
+	const struct automaton *ac;
+	const char *text;
+	size_t len;
+	int lineNum;
+	// The number of lines in this chunk, used to fix up global line numbers.
+	int *lastLine;
+	size_t *nextStart;
+	struct run_stats *stats;
+	struct unit_state units;
+	/*
+	 * Units are counted from 0 in every chunk, unit 0 being whatever continues from the
+	 * chunk before; they are fixed up while merging like line numbers.
+	 */
+	struct event_list found;
+	// Line numbers in here are local to the chunk, starting from 1.
+	pthread_t thread;
+};
+
+// A pair of co-occurring occurrences kept for LEGACY_ROWS, which has to be sorted.
+struct hit
+{
+	int first;
+	int second;
+	int firstOccur;
+	int secondOccur;
+};
+
+// The sweep line keeps the events of the last width lines in a ring buffer.
+struct sweep
+{
+	struct event *window;
+	size_t start;
+	size_t count;
+	size_t cap;
+	int width;
+	// The size of the co-occurrence window in lines.
+};
+
+// An edge of the co-occurrence graph.
+struct edge
+{
+	int first;
+	int second;
+	double weight;
+	// A count when there is no decay, which a double holds exactly up to 2^53.
+	_Bool used;
+	// False for an empty slot of the table.
+};
+
+struct pair_output
+{
+	enum outputStyle style;
+	struct csv_writer *writer;
+	struct character *charList;
+	struct hit *hits;
+	size_t hitNum;
+	size_t hitCap;
+	struct edge *edges;
+	// An open-addressing hash table keyed by the pair of names.
+	size_t edgeNum;
+	size_t edgeCap;
+	_Bool countEdges;
+	// Count edges in the table whatever the style is (used to keep the state file and the graph).
+	double *decay;
+	// The weight of a co-occurrence at each distance, or NULL when every one counts 1.
+	struct run_stats *stats;
+};
+
+// A character and its PageRank while the analytics are being sorted.
+struct ranking
+{
+	double rank;
+	uint32_t id;
+};
+
+// Settings chosen on the command line. The macros above are the defaults.
+struct options
+{
+	const char *inputFile;
+	const char *nameList;
+	const char *outputFile;
+	int window;
+	int threadNum;
+	enum outputStyle style;
+	_Bool streaming;
+	/*
+	 * Pass occurrences straight from the scanner to the sweep line, so only the
+	 * last window of lines is kept in memory however long the text is.
+	 */
+	const char *stateFile;
+	// Where the results of earlier runs are kept for incremental updates, or NULL.
+	_Bool foldCase;
+	_Bool wordBoundary;
+	const char *graphFile;
+	// Where the graph is saved for CharacterGraph.h, or NULL.
+	const char *analyticsFile;
+	// Where the centralities of the characters are written, or NULL.
+	enum windowUnit unit;
+	double decay;
+	const char *manifest;
+	// The list of books for the batch mode, or NULL.
+	struct run_stats *stats;
+	// NULL unless -p is given.
+	_Bool compress;
+	const char *query;
+	// The names to look up in the graph file, or NULL.
+};
+
+/*
+ * The beginning of a state file. It is followed by the names (length, then characters,
+ * then the number of aliases and each alias the same way), the line list of every name (length, then line numbers) and the edges.
+ * The file is written in the byte order of the machine.
+ */
+struct state_header
+{
+	char magic[8];
+	int window;
+	int nameNum;
+	int lastLine;
+	// The number of lines read so far.
+	long long offset;
+	// Where the next run starts reading: just after the last complete line.
+	size_t edgeNum;
+	int unit;
+	double decay;
+	struct unit_state units;
+	// The last unit so far and whether a boundary followed it.
+	_Bool foldCase;
+	_Bool wordBoundary;
+	// The names were matched under -c and -b.
+	uint64_t textHash;
+	// text_hash() of the first offset bytes, so another text of the same length is refused.
+	long long outputLen;
+	// The size of the STREAM_ROWS output after the rows of the last run, or -1.
+};
+
+// One book of a batch.
+struct book
+{
+	char *inputFile;
+	char *outputFile;
+};
+
+// The work shared by the threads of a batch.
+struct batch
+{
+	struct character *charList;
+	int nameNum;
+	const struct automaton *ac;
+	const struct options *opt;
+	struct book *books;
+	size_t bookNum;
+	size_t nextBook;
+	struct pair_output merged;
+	// The edges of all books added together.
+	pthread_mutex_t lock;
+	// Guards nextBook and merged.
 };
 
 // Function declarations.
-size_t read_names(struct character ***charList);
-void get_line_numbers(struct character ***charList, int nameNum);
-struct line *add_to_line_list(int lineNo);
-void analyse_and_output(struct character ***charList, int nameNum);
+void parse_options(int argc, char *argv[], struct options *opt);
+FILE *open_stream(const char *path, const char *mode);
+void close_stream(FILE *fp);
+void open_writer(struct csv_writer *w, const char *path, const char *mode,
+                 const struct character *charList, int nameNum, const struct options *opt);
+void close_writer(struct csv_writer *w, const char *path);
+size_t read_names(struct name_table *table, const char *path);
+size_t name_slot(const struct name_table *table, const char *name);
+void free_names(struct name_table *table);
+void build_automaton(struct automaton *ac, struct character *charList, int nameNum, const struct options *opt);
+void add_pattern(struct automaton *ac, const char *pattern, int nameNo);
+int add_state(struct automaton *ac);
+void free_automaton(struct automaton *ac);
+void get_line_numbers(struct character *charList, int nameNum, const struct automaton *ac, const struct options *opt);
+struct scan_task *new_tasks(const struct automaton *ac, int nameNum, int threadNum, struct run_stats *stats);
+void free_tasks(struct scan_task *tasks, int threadNum);
+const char *map_input(const char *path, size_t *len);
+int scan_mapped(struct character *charList, struct scan_task *tasks, int threadNum,
+                const char *text, size_t len, int lineBase, struct unit_state *units);
+int scan_block(struct character *charList, struct scan_task *tasks, int threadNum,
+               const char *text, size_t len, int lineBase, struct unit_state *units);
+void *scan_chunk(void *arg);
+void scan_line(const struct automaton *ac, const char *text, size_t len, int line,
+               int *lastLine, size_t *nextStart, struct unit_state *units, struct event_list *found);
+void add_event(struct event_list *list, int line, int nameNo);
+void add_to_line_list(struct character *ch, int lineNo);
+void analyse_and_output(struct character *charList, int nameNum, const struct options *opt);
+void sweep_line_lists(struct character *charList, int nameNum, int window, struct pair_output *out);
+void stream_and_output(struct character *charList, int nameNum, const struct automaton *ac, const struct options *opt);
+void update_and_output(struct character *charList, int nameNum, const struct automaton *ac, const struct options *opt);
+void batch_and_output(struct character *charList, int nameNum, const struct automaton *ac, const struct options *opt);
+void *batch_worker(void *arg);
+size_t read_manifest(const char *path, struct book **books);
+_Bool load_state(const char *path, struct character *charList, int nameNum, const struct options *opt,
+                 struct state_header *header, struct pair_output *out);
+void save_state(const char *path, struct character *charList, const struct state_header *header,
+                const struct pair_output *out);
+int read_spelling(FILE *fp, const char *spelling);
+void write_spelling(FILE *fp, const char *spelling);
+uint64_t text_hash(const char *text, size_t len);
+long long output_length(const char *path);
+size_t build_event_stream(struct character *charList, int nameNum, int fromLine, struct event **events);
+void sweep_push(struct sweep *sw, const struct event *ev, struct pair_output *out);
+void sweep_keep(struct sweep *sw, const struct event *ev);
+void emit_pair(struct pair_output *out, const struct event *earlier, const struct event *later);
+int compare_hits(const void *a, const void *b);
+void add_edge(struct pair_output *out, int first, int second, double weight);
+size_t edge_slot(const struct edge *edges, size_t edgeCap, int first, int second);
+int compare_edges(const void *a, const void *b);
+void flush_pairs(struct pair_output *out);
+void export_graph(const struct pair_output *out, int nameNum, const struct options *opt);
+void write_analytics(const struct character_graph *g, const struct options *opt);
+void query_graph(const struct options *opt);
+void print_edge(FILE *fp, const char *first, const char *second, double weight, const struct options *opt);
+int compare_rankings(const void *a, const void *b);
+void release_pairs(struct pair_output *out);
+double *new_decay(const struct options *opt);
+long long stats_clock(const struct run_stats *stats);
+void stats_time(struct run_stats *stats, enum statsPhase phase, long long since);
+void stats_add(struct run_stats *total, const struct run_stats *part);
+void print_stats(const struct run_stats *stats, FILE *fp);
 
-int main(void)
+#ifndef SOCIAL_NETWORK_LIBRARY
+int main(int argc, char *argv[])
 {
-	struct character **arrayList;
+	struct name_table names;
+	struct character *arrayList;
+	struct automaton ac;
+	struct options opt;
 	size_t nameNum;
-	nameNum = read_names(&arrayList);
-	get_line_numbers(&arrayList, nameNum);
-	analyse_and_output(&arrayList, nameNum);
-	free(arrayList); // After using allocated memory, free it.
+	long long started, since;
+	parse_options(argc, argv, &opt);
+	if ( opt.query )
+	{
+		query_graph(&opt);
+		return 0;
+	}
+	started = since = stats_clock(opt.stats);
+	nameNum = read_names(&names, opt.nameList);
+	arrayList = names.chars;
+	stats_time(opt.stats, READ_PHASE, since);
+	since = stats_clock(opt.stats);
+	build_automaton(&ac, arrayList, nameNum, &opt);
+	stats_time(opt.stats, COMPILE_PHASE, since);
+	if ( opt.manifest )
+	{
+		batch_and_output(arrayList, nameNum, &ac, &opt);
+		free_automaton(&ac);
+	}
+	else if ( opt.stateFile )
+	{
+		update_and_output(arrayList, nameNum, &ac, &opt);
+		free_automaton(&ac);
+	}
+	else if ( opt.streaming )
+	{
+		stream_and_output(arrayList, nameNum, &ac, &opt);
+		free_automaton(&ac);
+	}
+	else
+	{
+		get_line_numbers(arrayList, nameNum, &ac, &opt);
+		free_automaton(&ac);
+		analyse_and_output(arrayList, nameNum, &opt);
+	}
+	free_names(&names); // After using allocated memory, free it.
+	if ( opt.stats )
+	{
+		stats_time(opt.stats, TOTAL_PHASE, started);
+		print_stats(opt.stats, stderr);
+		free(opt.stats);
+	}
 	return 0;
 }
+#endif
 
 /*
- * Function: read_names
- * --------------------
- * Description: open the designated character list and parse the whole file.
- * Parameter: charList: a struct storing the content of the file.
- * Return: num: the number of names in the list.
+ * Function: parse_options
+ * -----------------------
+ * Description: read the settings from the command line with getopt().
+ *              Anything not given keeps the default from the macros.
+ * Parameters: argc, argv: the arguments of main();
+ *             opt: return the settings.
+ * Return: N/A.
  */
-size_t read_names(struct character ***charList)
+void parse_options(int argc, char *argv[], struct options *opt)
 {
-	FILE *fp = fopen(NAME_LIST, INPUT_MODE);
-	if ( fp == NULL )
-	{
-		perror(NAME_LIST);
-		exit(EXIT_FAILURE);
-	}
-	size_t num = 0;
-	char userinput[BUFFER_SIZE];
-	*charList = NULL;
-	while ( fscanf(fp, "%s", userinput) == NFIELD )
-	// Using fscanf() here is a little dangerous because of buffer overflow.
+	int c, distance;
+	double weight = 1.0;
+	_Bool styleGiven = false;
+	opt -> inputFile = INPUT_FILE;
+	opt -> nameList = NAME_LIST;
+	opt -> outputFile = OUTPUT_FILE;
+	opt -> window = CO_OCCURRENCE;
+	opt -> threadNum = SCAN_THREADS;
+	opt -> style = OUTPUT_STYLE;
+	opt -> streaming = false;
+	opt -> stateFile = NULL;
+	opt -> foldCase = false;
+	opt -> wordBoundary = false;
+	opt -> graphFile = NULL;
+	opt -> analyticsFile = NULL;
+	opt -> unit = WINDOW_UNIT;
+	opt -> decay = EDGE_DECAY;
+	opt -> manifest = NULL;
+	opt -> stats = NULL;
+	opt -> compress = false;
+	opt -> query = NULL;
+	while ( (c = getopt(argc, argv, OPTION_STRING)) != -1 )
 	{
-		*charList = realloc(*charList, (num + 1) * sizeof(struct character *));
-		// Create a point array for each name.
-		if ( charList == NULL )
+		switch ( c )
 		{
-			perror("charList");
-			exit(EXIT_FAILURE);
+			case 'i':
+				opt -> inputFile = optarg;
+				break;
+			case 'n':
+				opt -> nameList = optarg;
+				break;
+			case 'o':
+				opt -> outputFile = optarg;
+				break;
+			case 'w':
+				opt -> window = atoi(optarg);
+				break;
+			case 't':
+				opt -> threadNum = atoi(optarg);
+				break;
+			case 's':
+				if ( strcmp(optarg, "legacy") == 0 )
+				{
+					opt -> style = LEGACY_ROWS;
+				}
+				else if ( strcmp(optarg, "stream") == 0 )
+				{
+					opt -> style = STREAM_ROWS;
+				}
+				else if ( strcmp(optarg, "weighted") == 0 )
+				{
+					opt -> style = WEIGHTED_EDGES;
+				}
+				else
+				{
+					c = '?';
+				}
+				styleGiven = true;
+				break;
+			case 'S':
+				opt -> streaming = true;
+				break;
+			case 'u':
+				opt -> stateFile = optarg;
+				break;
+			case 'c':
+				opt -> foldCase = true;
+				break;
+			case 'b':
+				opt -> wordBoundary = true;
+				break;
+			case 'g':
+				opt -> graphFile = optarg;
+				break;
+			case 'a':
+				opt -> analyticsFile = optarg;
+				break;
+			case 'U':
+				if ( strcmp(optarg, "line") == 0 )
+				{
+					opt -> unit = LINE_UNITS;
+				}
+				else if ( strcmp(optarg, "sentence") == 0 )
+				{
+					opt -> unit = SENTENCE_UNITS;
+				}
+				else if ( strcmp(optarg, "paragraph") == 0 )
+				{
+					opt -> unit = PARAGRAPH_UNITS;
+				}
+				else
+				{
+					c = '?';
+				}
+				break;
+			case 'd':
+				opt -> decay = atof(optarg);
+				break;
+			case 'm':
+				opt -> manifest = optarg;
+				break;
+			case 'p':
+				if ( opt -> stats == NULL && (opt -> stats = calloc(1, sizeof(struct run_stats))) == NULL )
+				{
+					perror("stats");
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'z':
+				opt -> compress = true;
+				break;
+			case 'q':
+				opt -> query = optarg;
+				break;
+			default:
+				c = '?';
+				break;
 		}
-		(*charList)[num] = malloc(sizeof(struct character));
-		if ( (*charList)[num] == NULL )
+		if ( c == '?' || (c == 'w' && opt -> window < 1) || (c == 't' && opt -> threadNum < 1)
+		     || (c == 'd' && !(opt -> decay > 0.0 && opt -> decay <= 1.0)) )
 		{
-			perror("(*charList)[num]");
+			fprintf(stderr, "Usage: %s [-i text] [-n names] [-o output] [-w lines] [-t threads] "
+			                "[-s legacy|stream|weighted] [-S] [-u state] [-c] [-b] [-g graph] [-a analytics] "
+			                "[-U line|sentence|paragraph] [-d decay] [-m manifest] [-p] [-z] [-q name[,name]]\n", argv[0]);
 			exit(EXIT_FAILURE);
 		}
-		(*charList)[num] -> name = malloc(sizeof(char) * (strlen(userinput)+1));
-		// Extra space for null character.
-		if ( ((*charList)[num] -> name == NULL ) )
+	}
+	if ( opt -> manifest && (opt -> streaming || opt -> stateFile) )
+	{
+		fprintf(stderr, "%s: -m cannot be used with -S or -u\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	if ( opt -> streaming && opt -> stateFile == NULL )
+	// Only the streaming mode itself; -u keeps its own styles.
+	{
+		if ( styleGiven && opt -> style == LEGACY_ROWS )
 		{
-			perror("((*charList)[num] -> name");
+			fprintf(stderr, "%s: -S cannot keep every row for -s legacy; use -s stream or weighted\n", argv[0]);
 			exit(EXIT_FAILURE);
 		}
-		strcpy((*charList)[num] -> name, userinput);
-		num++;
+		if ( !styleGiven )
+		{
+			opt -> style = STREAM_ROWS;
+		}
 	}
-	if ( ferror(fp) )
+	if ( opt -> query && opt -> graphFile == NULL )
 	{
-		perror(NAME_LIST);
+		fprintf(stderr, "%s: -q needs the graph file of -g\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	for ( distance = 1; distance < opt -> window && weight > 0.0; distance++ )
+	// The same products as new_decay(), so no co-occurrence in the window weighs nothing.
+	{
+		weight *= opt -> decay;
+	}
+	if ( weight == 0.0 )
+	{
+		fprintf(stderr, "%s: -d %g underflows to 0 within a window of %d\n", argv[0], opt -> decay, opt -> window);
 		exit(EXIT_FAILURE);
 	}
-	fclose(fp);
-	return num;
 }
 
 /*
- * Function: get_line_numbers
- * --------------------------
- * Description: parse the whole novel and search for occurrences of names.
- * Parameters: charList: a struct storing the content of the file;
- *             nameNum: the number of names in the list.
+ * Function: open_stream
+ * ---------------------
+ * Description: open a file, where STDIO_PATH stands for stdin or stdout.
+ * Parameters: path: the file;
+ *             mode: INPUT_MODE or OUTPUT_MODE.
+ * Return: the stream, or NULL if the file cannot be opened.
+ */
+FILE *open_stream(const char *path, const char *mode)
+{
+	if ( strcmp(path, STDIO_PATH) == 0 )
+	{
+		return mode[0] == 'r' ? stdin : stdout;
+	}
+	return fopen(path, mode);
+}
+
+/*
+ * Function: close_stream
+ * ----------------------
+ * Description: close a stream from open_stream(); stdin and stdout are only flushed.
+ * Parameter: fp: the stream.
+ * Return: N/A.
+ */
+void close_stream(FILE *fp)
+{
+	if ( fp == stdin || fp == stdout )
+	{
+		fflush(fp);
+	}
+	else
+	{
+		fclose(fp);
+	}
+}
+
+/*
+ * Function: open_writer
+ * ---------------------
+ * Description: open a file for rows and a writer on it, compressed if -z is given.
+ * Parameters: w: return the writer;
+ *             path: the file, where STDIO_PATH stands for stdout;
+ *             mode: OUTPUT_MODE or APPEND_MODE;
+ *             charList: the names the rows are made of;
+ *             nameNum: the number of names in the list;
+ *             opt: whether to compress.
  * Return: N/A.
  */
-void get_line_numbers(struct character ***charList, int nameNum)
+void open_writer(struct csv_writer *w, const char *path, const char *mode,
+                 const struct character *charList, int nameNum, const struct options *opt)
 {
-	FILE *fp = fopen(INPUT_FILE, INPUT_MODE);
+	int num;
+	FILE *fp = open_stream(path, mode);
+	const char **names = malloc(sizeof(char *) * (nameNum + 1));
 	if ( fp == NULL )
 	{
-		perror(INPUT_FILE);
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	if ( names == NULL )
+	{
+		perror("names");
 		exit(EXIT_FAILURE);
 	}
-	size_t num;
-	int line;
-	char userinput[BUFFER_SIZE], *strPtr;
-	struct line *prev, *curr;
 	for ( num = 0; num < nameNum; num++ )
-	// Parse the whole file (nameNum) times.
-	{
-		(*charList)[num] -> lineList = NULL; // Initialise the head of the list.
-		line = 0;
-		// Every time parse from the first line of file.
-		while ( fgets(userinput, BUFFER_SIZE, fp) != NULL )
-		{
-			line++;
-			strPtr = userinput;
-			// Point to the beginning of userinput.
-			while ( (strPtr = strstr(strPtr, (*charList)[num] -> name)) )
-			// N.B.: "=" instead of "==".
-			{
-				strPtr += strlen((*charList)[num] -> name);
-				// If the same name occurs multiple times in a line.
-				if ( (*charList)[num] -> lineList == NULL )
-				// If it is the first node in the list.
-				{
-					(*charList)[num] -> lineList = add_to_line_list(line);
-					prev = (*charList)[num] -> lineList;
-				}
-				else
-				{
-					curr = add_to_line_list(line);
-					prev -> next = curr;
-					prev = curr;
-				}
-			}
-		}
-		if ( ferror(fp) )
-		{
-			perror(INPUT_FILE);
-			// In this case, if an error occurs, the program will keep running.
-		}
-		rewind(fp);
-		/*
-		 * EOF and error internal indicators of fp are cleared.
-		 * The statement is equivalent to `(void) fseek(fp, 0L, SEEK_SET);`, 
-		 * but does not check if the operation succeeded.
-		 */
+	{
+		names[num] = charList[num].name;
 	}
-	fclose(fp);
+	if ( writer_open(w, fp, names, nameNum, opt -> compress) == -1 )
+	{
+		perror("writer");
+		exit(EXIT_FAILURE);
+	}
+	free(names);
 }
 
 /*
- * Function: add_to_line_list
- * --------------------------
- * Description: add line number to lists for each name.
- * Parameter: lineNo: line number.
- * Return: cp: a pointer to newly allocated memory.
+ * Function: close_writer
+ * ----------------------
+ * Description: flush a writer from open_writer() and close its file.
+ * Parameters: w: the writer;
+ *             path: the file, for the error message.
+ * Return: N/A.
  */
-struct line *add_to_line_list(int lineNo)
+void close_writer(struct csv_writer *w, const char *path)
 {
-	struct line *structPtr = malloc(sizeof(struct line));
-	if ( structPtr == NULL )
+	if ( writer_close(w) == -1 )
 	{
-		perror("structPtr");
+		perror(path);
 		exit(EXIT_FAILURE);
 	}
-	structPtr -> lineNo = lineNo;
-	structPtr -> next = NULL;
-	return structPtr;
+	close_stream(w -> fp);
 }
 
 /*
- * Function: analyse_and_output
- * ----------------------------
- * Description: analyse lists for each name and output the result into the designated file.
- * Parameters: charList: a struct storing the content of the file.
- *             nameNum: the number of names in the list.
- * Return: N/A.
+ * Function: read_names
+ * --------------------
+ * Description: open the designated character list and parse the whole file.
+ *              Each word is a name, optionally followed by its aliases separated by
+ *              ALIAS_SEPARATOR; all of them count as the first one.
+ *              The file is read into one block, grown by doubling, and the words are
+ *              cut in place; the block is then grown once more to hold the characters,
+ *              the alias pointers and the hash table, so the whole table is one allocation.
+ *              Names are interned through the hash table: a name listed again gets the
+ *              id of its first entry, and its aliases are added to that character.
+ * Parameters: table: return the names;
+ *             path: the character list.
+ * Return: the number of different names in the list.
  */
-void analyse_and_output(struct character ***charList, int nameNum)
+size_t read_names(struct name_table *table, const char *path)
 {
-	FILE *fp = fopen(OUTPUT_FILE, OUTPUT_MODE);
+	FILE *fp = fopen(path, INPUT_MODE);
 	if ( fp == NULL )
 	{
-		perror(OUTPUT_FILE);
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	size_t num = 0, aliasNum = 0, len = 0, cap = INITIAL_NAME_BYTES, got, pos, slot, word, wordNum = 0;
+	size_t charsAt, aliasesAt, slotsAt, wordAliasesAt, wordIdsAt, wordCountsAt;
+	char *block = malloc(cap), *strPtr, *name, **aliases, **wordAliases;
+	int *wordIds, *wordCounts, id;
+	struct character *ch;
+	if ( block == NULL )
+	{
+		perror("names");
 		exit(EXIT_FAILURE);
 	}
-	size_t i, j;
-	struct line *first, *second, *secondFirstPair;
-	_Bool firstPairForFirst;
-	// The flag variable is used to check if current pair is the first one for current node in first.
-	// A variant of bubble sorting.
-	for ( i = 0; i < nameNum - 1; i++ )
+	while ( (got = fread(block + len, 1, cap - len, fp)) > 0 )
 	{
-		if ( (*charList)[i] -> lineList == NULL )
+		len += got;
+		if ( len == cap )
 		{
-			continue;
-			// End current for-loop (i) and make first point to next name.
+			cap *= 2;
+			block = realloc(block, cap);
+			if ( block == NULL )
+			{
+				perror("names");
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	if ( ferror(fp) )
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	fclose(fp);
+	for ( pos = 0; pos < len; pos++ )
+	// Count the words and the separators, which bound the number of aliases.
+	{
+		if ( !isspace((unsigned char) block[pos]) && (pos == 0 || isspace((unsigned char) block[pos - 1])) )
+		{
+			num++;
+		}
+		if ( block[pos] == ALIAS_SEPARATOR )
+		{
+			aliasNum++;
+		}
+	}
+	for ( table -> slotCap = INITIAL_NAME_SLOTS; table -> slotCap < 2 * num; table -> slotCap *= 2 )
+	{
+		;
+	}
+	charsAt = (len + NAME_ALIGN) & ~(size_t) (NAME_ALIGN - 1);
+	// Past the text and its terminating null character.
+	aliasesAt = charsAt + num * sizeof(struct character);
+	slotsAt = aliasesAt + aliasNum * sizeof(char *);
+	wordAliasesAt = slotsAt + table -> slotCap * sizeof(int);
+	wordIdsAt = wordAliasesAt + aliasNum * sizeof(char *);
+	wordCountsAt = wordIdsAt + num * sizeof(int);
+	// The aliases of every word in list order, and its id and number of aliases,
+	// from which the aliases are then gathered per character.
+	block = realloc(block, wordCountsAt + num * sizeof(int) + 1);
+	if ( block == NULL )
+	{
+		perror("names");
+		exit(EXIT_FAILURE);
+	}
+	block[len] = '\0';
+	table -> block = block;
+	table -> chars = (struct character *) (block + charsAt);
+	table -> slots = (int *) (block + slotsAt);
+	table -> nameNum = 0;
+	memset(table -> slots, 0, table -> slotCap * sizeof(int));
+	wordAliases = (char **) (block + wordAliasesAt);
+	wordIds = (int *) (block + wordIdsAt);
+	wordCounts = (int *) (block + wordCountsAt);
+	for ( pos = 0; pos < len; )
+	{
+		while ( pos < len && isspace((unsigned char) block[pos]) )
+		{
+			pos++;
 		}
-		for ( j = i + 1; j < nameNum; j++ )
+		if ( pos == len )
 		{
-			secondFirstPair = (*charList)[j] -> lineList;
-			/*
-			 * secondFirstPair points to the position of the first node in second
-			 * which counts as a co-occurrence with previous node in first.
-			 * It is initialised by the first node in second.
-			 */
-			if ( secondFirstPair == NULL )
+			break;
+		}
+		name = block + pos;
+		while ( pos < len && !isspace((unsigned char) block[pos]) )
+		{
+			pos++;
+		}
+		block[pos++] = '\0';
+		// The last word is ended by the null character after the text.
+		if ( *name == ALIAS_SEPARATOR )
+		{
+			fprintf(stderr, "%s: \"%s\" has no name before its aliases\n", path, name);
+			exit(EXIT_FAILURE);
+		}
+		wordCounts[wordNum] = 0;
+		for ( strPtr = strchr(name, ALIAS_SEPARATOR); strPtr; strPtr = strchr(strPtr, ALIAS_SEPARATOR) )
+		// Cut the word at every separator and point the aliases into it.
+		{
+			*strPtr++ = '\0';
+			if ( *strPtr && *strPtr != ALIAS_SEPARATOR )
+			// Empty aliases would match everywhere, so they are skipped.
 			{
-				continue;
-				// End current for-loop (j) and make second point to next name.
+				*wordAliases++ = strPtr;
+				wordCounts[wordNum]++;
 			}
-			first = (*charList)[i] -> lineList;
-			while ( first )
-			// If first does not reach the end, continue the loop.
+		}
+		slot = name_slot(table, name);
+		if ( table -> slots[slot] == 0 )
+		{
+			ch = &table -> chars[table -> nameNum];
+			ch -> name = name;
+			ch -> aliasNum = 0;
+			ch -> lineList = NULL;
+			ch -> lineNum = ch -> lineCap = 0;
+			table -> slots[slot] = ++table -> nameNum;
+		}
+		wordIds[wordNum] = table -> slots[slot] - 1;
+		table -> chars[wordIds[wordNum]].aliasNum += wordCounts[wordNum];
+		wordNum++;
+	}
+	aliases = (char **) (block + aliasesAt);
+	for ( id = 0; id < table -> nameNum; id++ )
+	// Give every character its share of the alias pointers, then fill them in list order.
+	{
+		table -> chars[id].aliases = aliases;
+		aliases += table -> chars[id].aliasNum;
+		table -> chars[id].aliasNum = 0;
+	}
+	wordAliases = (char **) (block + wordAliasesAt);
+	for ( word = 0; word < wordNum; word++ )
+	{
+		ch = &table -> chars[wordIds[word]];
+		memcpy(ch -> aliases + ch -> aliasNum, wordAliases, wordCounts[word] * sizeof(char *));
+		ch -> aliasNum += wordCounts[word];
+		wordAliases += wordCounts[word];
+	}
+	return table -> nameNum;
+}
+
+/*
+ * Function: name_slot
+ * -------------------
+ * Description: find the slot of a name in the hash table with FNV-1a and linear probing.
+ * Parameters: table: the names;
+ *             name: the name.
+ * Return: the slot holding the name, or the empty slot where it belongs.
+ */
+size_t name_slot(const struct name_table *table, const char *name)
+{
+	const unsigned char *strPtr;
+	uint32_t hash = 2166136261u;
+	size_t slot;
+	for ( strPtr = (const unsigned char *) name; *strPtr; strPtr++ )
+	{
+		hash = (hash ^ *strPtr) * 16777619u;
+	}
+	for ( slot = hash & (table -> slotCap - 1); table -> slots[slot]; slot = (slot + 1) & (table -> slotCap - 1) )
+	{
+		if ( strcmp(table -> chars[table -> slots[slot] - 1].name, name) == 0 )
+		{
+			break;
+		}
+	}
+	return slot;
+}
+
+/*
+ * Function: free_names
+ * --------------------
+ * Description: release the names and their line lists.
+ * Parameter: table: the names.
+ * Return: N/A.
+ */
+void free_names(struct name_table *table)
+{
+	int num;
+	for ( num = 0; num < table -> nameNum; num++ )
+	{
+		free(table -> chars[num].lineList);
+	}
+	free(table -> block);
+	table -> block = NULL;
+}
+
+/*
+ * Function: build_automaton
+ * -------------------------
+ * Description: compile all names and aliases into one Aho-Corasick automaton.
+ *              Names are inserted into a trie first, then fail links are
+ *              computed breadth-first and missing transitions are filled in,
+ *              so that matching costs one table lookup per character.
+ *              Ignoring case costs nothing while matching: upper-case letters
+ *              simply share the byte class of their lower-case letters.
+ * Parameters: ac: the automaton to be built;
+ *             charList: a struct storing the names;
+ *             nameNum: the number of names in the list;
+ *             opt: whether to ignore case and match whole words only.
+ * Return: N/A.
+ */
+void build_automaton(struct automaton *ac, struct character *charList, int nameNum, const struct options *opt)
+{
+	int num, alias, state, child, c, head, tail, *queue;
+	const unsigned char *strPtr;
+	memset(ac, 0, sizeof(struct automaton));
+	ac -> nameNum = nameNum;
+	ac -> foldCase = opt -> foldCase;
+	ac -> wordBoundary = opt -> wordBoundary;
+	for ( c = 0; c < ALPHABET_SIZE; c++ )
+	{
+		ac -> wordChar[c] = isalnum(c) || c == '_' || c >= 0x80;
+		ac -> sentenceEnd[c] = c != '\0' && strchr(SENTENCE_END, c) != NULL;
+	}
+	ac -> unit = opt -> unit;
+	ac -> classNum = 1;
+	for ( num = 0; num < nameNum; num++ )
+	// Give every byte used by a name its own class.
+	{
+		for ( alias = -1; alias < charList[num].aliasNum; alias++ )
+		{
+			strPtr = (const unsigned char *) (alias == -1 ? charList[num].name : charList[num].aliases[alias]);
+			for ( ; *strPtr; strPtr++ )
 			{
-				second = secondFirstPair;
-				firstPairForFirst = false;
-				// Before scanning second for next node in first, variables have to be initialised.
-				while ( second && (first -> lineNo + CO_OCCURRENCE > second -> lineNo) )
-				/*
-				 * If second does not reach the end or line numbers of second are
-				 * still possibly within five lines, continue the loop.
-				 */
+				c = ac -> foldCase ? tolower(*strPtr) : *strPtr;
+				if ( ac -> byteClass[c] == 0 )
 				{
-					if ( abs((first -> lineNo) - (second -> lineNo)) < CO_OCCURRENCE )
-					// Find the required pair.
-					{
-						fprintf(fp, CSV_FORMAT, (*charList)[i] -> name, (*charList)[j] -> name);
-						if ( firstPairForFirst == false )
-						// If it is the first pair for current node in first.
-						{
-							firstPairForFirst = true;
-							secondFirstPair = second;
-						}
-					}
-					second = second -> next;
+					ac -> byteClass[c] = ac -> classNum++;
 				}
-				first = first -> next;
 			}
+			ac -> patternNum++;
 		}
 	}
+	if ( ac -> foldCase )
+	{
+		for ( c = 'A'; c <= 'Z'; c++ )
+		{
+			ac -> byteClass[c] = ac -> byteClass[tolower(c)];
+		}
+	}
+	ac -> patternLen = malloc(sizeof(size_t) * (ac -> patternNum + 1));
+	ac -> patternName = malloc(sizeof(int) * (ac -> patternNum + 1));
+	ac -> sameOutput = malloc(sizeof(int) * (ac -> patternNum + 1));
+	// One extra slot so that an empty list does not ask for zero bytes.
+	if ( ac -> patternLen == NULL || ac -> patternName == NULL || ac -> sameOutput == NULL )
+	{
+		perror("ac");
+		exit(EXIT_FAILURE);
+	}
+	add_state(ac); // The root is state 0.
+	ac -> patternNum = 0;
+	for ( num = 0; num < nameNum; num++ )
+	{
+		add_pattern(ac, charList[num].name, num);
+		for ( alias = 0; alias < charList[num].aliasNum; alias++ )
+		{
+			add_pattern(ac, charList[num].aliases[alias], num);
+		}
+	}
+	queue = malloc(sizeof(int) * ac -> stateNum);
+	if ( queue == NULL )
+	{
+		perror("queue");
+		exit(EXIT_FAILURE);
+	}
+	head = tail = 0;
+	for ( c = 0; c < ac -> classNum; c++ )
+	// Children of the root fail back to the root.
+	{
+		child = ac -> next[c];
+		if ( child )
+		{
+			ac -> fail[child] = 0;
+			ac -> dictLink[child] = 0;
+			queue[tail++] = child;
+		}
+	}
+	while ( head < tail )
+	// Breadth-first, so the fail state of a parent is always complete before its children.
+	{
+		state = queue[head++];
+		for ( c = 0; c < ac -> classNum; c++ )
+		{
+			child = ac -> next[state * ac -> classNum + c];
+			if ( child )
+			{
+				ac -> fail[child] = ac -> next[ac -> fail[state] * ac -> classNum + c];
+				ac -> dictLink[child] = ac -> output[ac -> fail[child]] != -1
+				                        ? ac -> fail[child] : ac -> dictLink[ac -> fail[child]];
+				queue[tail++] = child;
+			}
+			else
+			{
+				ac -> next[state * ac -> classNum + c] = ac -> next[ac -> fail[state] * ac -> classNum + c];
+			}
+		}
+	}
+	free(queue);
+}
+
+/*
+ * Function: add_pattern
+ * ---------------------
+ * Description: insert a name or an alias into the trie.
+ *              State 0 means "no child" at this stage.
+ * Parameters: ac: the automaton;
+ *             pattern: the spelling;
+ *             nameNo: the name it belongs to.
+ * Return: N/A.
+ */
+void add_pattern(struct automaton *ac, const char *pattern, int nameNo)
+{
+	int state = 0, child, c;
+	const unsigned char *strPtr;
+	for ( strPtr = (const unsigned char *) pattern; *strPtr; strPtr++ )
+	{
+		c = ac -> byteClass[*strPtr];
+		if ( ac -> next[state * ac -> classNum + c] == 0 )
+		{
+			child = add_state(ac);
+			ac -> next[state * ac -> classNum + c] = child;
+		}
+		state = ac -> next[state * ac -> classNum + c];
+	}
+	ac -> patternLen[ac -> patternNum] = strlen(pattern);
+	ac -> patternName[ac -> patternNum] = nameNo;
+	ac -> sameOutput[ac -> patternNum] = ac -> output[state];
+	ac -> output[state] = ac -> patternNum;
+	// Duplicated patterns are chained, the later one first.
+	ac -> patternNum++;
+}
+
+/*
+ * Function: add_state
+ * -------------------
+ * Description: append a new state to the automaton, growing the tables geometrically.
+ * Parameter: ac: the automaton.
+ * Return: the index of the new state.
+ */
+int add_state(struct automaton *ac)
+{
+	if ( ac -> stateNum == ac -> stateCap )
+	{
+		ac -> stateCap = ac -> stateCap ? ac -> stateCap * 2 : INITIAL_STATES;
+		ac -> next = realloc(ac -> next, sizeof(int) * ac -> stateCap * ac -> classNum);
+		ac -> fail = realloc(ac -> fail, sizeof(int) * ac -> stateCap);
+		ac -> output = realloc(ac -> output, sizeof(int) * ac -> stateCap);
+		ac -> dictLink = realloc(ac -> dictLink, sizeof(int) * ac -> stateCap);
+		if ( ac -> next == NULL || ac -> fail == NULL || ac -> output == NULL || ac -> dictLink == NULL )
+		{
+			perror("ac");
+			exit(EXIT_FAILURE);
+		}
+	}
+	memset(ac -> next + ac -> stateNum * ac -> classNum, 0, sizeof(int) * ac -> classNum);
+	ac -> fail[ac -> stateNum] = 0;
+	ac -> output[ac -> stateNum] = -1;
+	ac -> dictLink[ac -> stateNum] = 0;
+	return ac -> stateNum++;
+}
+
+/*
+ * Function: free_automaton
+ * ------------------------
+ * Description: release the memory held by the automaton.
+ * Parameter: ac: the automaton.
+ * Return: N/A.
+ */
+void free_automaton(struct automaton *ac)
+{
+	free(ac -> next);
+	free(ac -> fail);
+	free(ac -> output);
+	free(ac -> dictLink);
+	free(ac -> sameOutput);
+	free(ac -> patternName);
+	free(ac -> patternLen);
+}
+
+/*
+ * Function: get_line_numbers
+ * --------------------------
+ * Description: parse the whole novel once and search for occurrences of all names.
+ *              The novel is scanned in place when it can be mapped into memory;
+ *              otherwise it is read through stdio in blocks of whole lines.
+ *              Either way the text is cut into line-aligned chunks which may be
+ *              scanned by several threads, and the result is the same.
+ * Parameters: charList: a struct storing the content of the file;
+ *             nameNum: the number of names in the list;
+ *             ac: the automaton built from the names;
+ *             opt: the input file and the number of threads.
+ * Return: N/A.
+ */
+void get_line_numbers(struct character *charList, int nameNum, const struct automaton *ac, const struct options *opt)
+{
+	int num, lineBase = 0, threadNum = opt -> threadNum;
+	size_t len, cut, filled = 0, bufSize = (size_t) CHUNK_SIZE * threadNum;
+	const char *text;
+	char *buffer;
+	_Bool atEnd = false;
+	FILE *fp;
+	long long since = stats_clock(opt -> stats);
+	struct unit_state units = { 0, true, false };
+	// So that the first word starts unit 1.
+	struct scan_task *tasks = new_tasks(ac, nameNum, threadNum, opt -> stats);
+	for ( num = 0; num < nameNum; num++ )
+	{
+		charList[num].lineList = NULL; // Initialise the list.
+		charList[num].lineNum = charList[num].lineCap = 0;
+	}
+	text = map_input(opt -> inputFile, &len);
+	if ( text )
+	{
+		scan_mapped(charList, tasks, threadNum, text, len, lineBase, &units);
+		munmap((void *) text, len);
+	}
+	else
+	// Fall back to stdio, e.g. when the input is a pipe.
+	{
+		fp = open_stream(opt -> inputFile, INPUT_MODE);
+		buffer = malloc(bufSize);
+		if ( fp == NULL )
+		{
+			perror(opt -> inputFile);
+			exit(EXIT_FAILURE);
+		}
+		if ( buffer == NULL )
+		{
+			perror("buffer");
+			exit(EXIT_FAILURE);
+		}
+		while ( !atEnd )
+		{
+			filled += fread(buffer + filled, 1, bufSize - filled, fp);
+			atEnd = filled < bufSize;
+			// A short read means the end of file (or an error).
+			cut = filled;
+			if ( !atEnd )
+			// Only whole lines are scanned; the rest is kept for the next block.
+			{
+				while ( cut > 0 && buffer[cut - 1] != '\n' )
+				{
+					cut--;
+				}
+				if ( cut == 0 )
+				// A single line longer than the buffer: make the buffer bigger.
+				{
+					bufSize *= 2;
+					buffer = realloc(buffer, bufSize);
+					if ( buffer == NULL )
+					{
+						perror("buffer");
+						exit(EXIT_FAILURE);
+					}
+					continue;
+				}
+			}
+			lineBase = scan_block(charList, tasks, threadNum, buffer, cut, lineBase, &units);
+			memmove(buffer, buffer + cut, filled - cut);
+			filled -= cut;
+		}
+		if ( ferror(fp) )
+		{
+			perror(opt -> inputFile);
+			// In this case, if an error occurs, the program will keep running.
+		}
+		free(buffer);
+		close_stream(fp);
+	}
+	free_tasks(tasks, threadNum);
+	stats_time(opt -> stats, SCAN_PHASE, since);
+}
+
+/*
+ * Function: new_tasks
+ * -------------------
+ * Description: allocate one scan_task per thread.
+ * Parameters: ac: the automaton built from the names;
+ *             nameNum: the number of names in the list;
+ *             threadNum: the number of threads;
+ *             stats: the counters for -p, or NULL.
+ * Return: the array of tasks.
+ */
+struct scan_task *new_tasks(const struct automaton *ac, int nameNum, int threadNum, struct run_stats *stats)
+{
+	int task;
+	struct scan_task *tasks = calloc(threadNum, sizeof(struct scan_task));
+	if ( tasks == NULL )
+	{
+		perror("tasks");
+		exit(EXIT_FAILURE);
+	}
+	for ( task = 0; task < threadNum; task++ )
+	{
+		tasks[task].ac = ac;
+		tasks[task].stats = stats;
+		tasks[task].lastLine = malloc(sizeof(int) * (nameNum + 1));
+		tasks[task].nextStart = malloc(sizeof(size_t) * (nameNum + 1));
+		if ( tasks[task].lastLine == NULL || tasks[task].nextStart == NULL )
+		{
+			perror("tasks");
+			exit(EXIT_FAILURE);
+		}
+	}
+	return tasks;
+}
+
+/*
+ * Function: free_tasks
+ * --------------------
+ * Description: release the tasks from new_tasks().
+ * Parameters: tasks: the array of tasks;
+ *             threadNum: the number of threads.
+ * Return: N/A.
+ */
+void free_tasks(struct scan_task *tasks, int threadNum)
+{
+	int task;
+	for ( task = 0; task < threadNum; task++ )
+	{
+		free(tasks[task].lastLine);
+		free(tasks[task].nextStart);
+		free(tasks[task].found.events);
+	}
+	free(tasks);
+}
+
+/*
+ * Function: map_input
+ * -------------------
+ * Description: map a regular file into memory for reading.
+ * Parameters: path: the file;
+ *             len: return the length of the file.
+ * Return: the address of the mapped file, or NULL if it cannot be mapped
+ *         (not a regular file, empty, or mmap() failed).
+ */
+const char *map_input(const char *path, size_t *len)
+{
+	struct stat info;
+	void *addr;
+	int fd = open(path, O_RDONLY);
+	if ( fd == -1 )
+	{
+		return NULL;
+		// Let the stdio fallback report the error.
+	}
+	if ( fstat(fd, &info) == -1 || !S_ISREG(info.st_mode) || info.st_size == 0 )
+	{
+		close(fd);
+		return NULL;
+	}
+	*len = (size_t) info.st_size;
+	addr = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping stays valid after the descriptor is closed.
+	if ( addr == MAP_FAILED )
+	{
+		return NULL;
+	}
+	posix_madvise(addr, *len, POSIX_MADV_SEQUENTIAL);
+	return addr;
+}
+
+/*
+ * Function: scan_mapped
+ * ---------------------
+ * Description: scan text which is already in memory, about (CHUNK_SIZE * threadNum)
+ *              bytes at a time, each block finishing its last line.
+ * Parameters: charList: a struct storing the content of the file;
+ *             tasks: one scan_task per thread;
+ *             threadNum: the number of threads;
+ *             text: the text;
+ *             len: the length of the text;
+ *             lineBase: the number of lines before the text;
+ *             units: the units before the text, updated to the end of it.
+ * Return: the number of lines up to the end of the text.
+ */
+int scan_mapped(struct character *charList, struct scan_task *tasks, int threadNum,
+                const char *text, size_t len, int lineBase, struct unit_state *units)
+{
+	size_t from, cut, blockSize = (size_t) CHUNK_SIZE * threadNum;
+	const char *newline;
+	for ( from = 0; from < len; from = cut )
+	{
+		cut = len - from <= blockSize ? len : from + blockSize;
+		if ( cut < len && (newline = memchr(text + cut - 1, '\n', len - cut + 1)) )
+		{
+			cut = newline - text + 1;
+		}
+		else
+		{
+			cut = len;
+		}
+		lineBase = scan_block(charList, tasks, threadNum, text + from, cut - from, lineBase, units);
+	}
+	return lineBase;
+}
+
+/*
+ * Function: scan_block
+ * --------------------
+ * Description: cut a block of whole lines into one chunk per thread, scan the chunks
+ *              and merge what was found in order. Each thread numbers its lines
+ *              from 1, so the line numbers are shifted while merging. So are units,
+ *              after deciding whether the first words of a chunk continue the last
+ *              unit of the chunk before.
+ * Parameters: charList: a struct storing the content of the file;
+ *             tasks: one scan_task per thread;
+ *             threadNum: the number of threads;
+ *             text: the block, which ends with a complete line;
+ *             len: the length of the block;
+ *             lineBase: the number of lines before this block;
+ *             units: the units before this block, updated to the end of it.
+ * Return: the number of lines up to the end of this block.
+ */
+int scan_block(struct character *charList, struct scan_task *tasks, int threadNum,
+               const char *text, size_t len, int lineBase, struct unit_state *units)
+{
+	int task, base;
+	struct character *ch;
+	size_t pos, from, to;
+	const char *newline;
+	for ( task = 0, from = 0; task < threadNum; task++ )
+	// Cut the block into chunks, each of which ends just after a newline.
+	{
+		to = task == threadNum - 1 ? len : len / threadNum * (task + 1);
+		if ( to <= from )
+		{
+			to = from;
+		}
+		else if ( to < len )
+		{
+			newline = memchr(text + to - 1, '\n', len - to + 1);
+			to = newline ? (size_t) (newline - text) + 1 : len;
+		}
+		tasks[task].text = text + from;
+		tasks[task].len = to - from;
+		tasks[task].found.num = 0;
+		if ( threadNum == 1 )
+		{
+			scan_chunk(&tasks[task]);
+		}
+		else if ( pthread_create(&tasks[task].thread, NULL, scan_chunk, &tasks[task]) != 0 )
+		{
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+		from = to;
+	}
+	for ( task = 0; task < threadNum; task++ )
+	{
+		if ( threadNum > 1 )
+		{
+			pthread_join(tasks[task].thread, NULL);
+		}
+		if ( tasks[task].ac -> unit == LINE_UNITS )
+		{
+			base = lineBase;
+		}
+		else
+		{
+			base = units -> unit;
+			if ( tasks[task].units.opened && units -> pending )
+			// Unit 0 of the chunk is a new unit rather than the last one going on.
+			{
+				base++;
+			}
+			units -> pending = tasks[task].units.pending
+			                   || (units -> pending && tasks[task].units.unit == 0 && !tasks[task].units.opened);
+			units -> unit = base + tasks[task].units.unit;
+		}
+		if ( tasks[task].stats )
+		{
+			tasks[task].stats -> lines += tasks[task].lineNum;
+			tasks[task].stats -> bytes += tasks[task].len;
+			tasks[task].stats -> matches += tasks[task].found.num;
+		}
+		for ( pos = 0; pos < tasks[task].found.num; pos++ )
+		{
+			ch = &charList[tasks[task].found.events[pos].nameNo];
+			if ( tasks[task].stats && ch -> lineNum == ch -> lineCap )
+			{
+				tasks[task].stats -> lineAllocs++;
+			}
+			add_to_line_list(ch, base + tasks[task].found.events[pos].lineNo);
+		}
+		lineBase += tasks[task].lineNum;
+	}
+	return lineBase;
+}
+
+/*
+ * Function: scan_chunk
+ * --------------------
+ * Description: the thread function of the scan. Lines are found with memchr(),
+ *              which is vectorised by the C library, and handed to scan_line()
+ *              in place, however long they are.
+ * Parameter: arg: the scan_task of this thread.
+ * Return: NULL.
+ */
+void *scan_chunk(void *arg)
+{
+	struct scan_task *task = arg;
+	const char *newline;
+	size_t pos = 0, len;
+	int num;
+	for ( num = 0; num < task -> ac -> nameNum; num++ )
+	{
+		task -> lastLine[num] = 0;
+	}
+	task -> lineNum = 0;
+	task -> units.unit = 0;
+	task -> units.pending = task -> units.opened = false;
+	while ( pos < task -> len )
+	{
+		newline = memchr(task -> text + pos, '\n', task -> len - pos);
+		len = newline ? (size_t) (newline - (task -> text + pos)) + 1 : task -> len - pos;
+		task -> lineNum++;
+		scan_line(task -> ac, task -> text + pos, len, task -> lineNum, task -> lastLine, task -> nextStart,
+		          task -> ac -> unit == LINE_UNITS ? NULL : &task -> units, &task -> found);
+		pos += len;
+	}
+	return NULL;
+}
+
+/*
+ * Function: scan_line
+ * -------------------
+ * Description: run the automaton over one line and collect occurrences of all names.
+ *              The result is the same as searching each name with strstr() separately:
+ *              occurrences of one name in a line never overlap each other, even when
+ *              they are different aliases. Like strstr(), the search stops at a null
+ *              character. Word boundaries are only looked at when a pattern matches.
+ * Parameters: ac: the automaton built from the names;
+ *             text: the line, which does not have to be null-terminated;
+ *             len: the maximum number of characters to be scanned;
+ *             line: the line number;
+ *             lastLine, nextStart: for each name, the line of its previous occurrence
+ *                                  and where that occurrence ends;
+ *             units: the sentence or paragraph so far, or NULL to record line numbers;
+ *             found: where the occurrences go.
+ * Return: N/A.
+ */
+void scan_line(const struct automaton *ac, const char *text, size_t len, int line,
+               int *lastLine, size_t *nextStart, struct unit_state *units, struct event_list *found)
+{
+	int num, pattern, state = 0, match;
+	size_t pos, start;
+	_Bool blank = true;
+	for ( pos = 0; pos < len && text[pos] != '\0'; pos++ )
+	{
+		if ( units )
+		// Count the units in the same pass as the matching.
+		{
+			if ( ac -> wordChar[(unsigned char) text[pos]] )
+			{
+				if ( units -> pending )
+				{
+					units -> unit++;
+					units -> pending = false;
+				}
+				else if ( units -> unit == 0 )
+				{
+					units -> opened = true;
+				}
+				blank = false;
+			}
+			else if ( ac -> unit == SENTENCE_UNITS && ac -> sentenceEnd[(unsigned char) text[pos]] )
+			{
+				units -> pending = true;
+			}
+		}
+		state = ac -> next[state * ac -> classNum + ac -> byteClass[(unsigned char) text[pos]]];
+		match = ac -> output[state] != -1 ? state : ac -> dictLink[state];
+		for ( ; match; match = ac -> dictLink[match] )
+		// Walk every pattern ending at this character.
+		{
+			for ( pattern = ac -> output[match]; pattern != -1; pattern = ac -> sameOutput[pattern] )
+			{
+				start = pos + 1 - ac -> patternLen[pattern];
+				if ( ac -> wordBoundary
+				     && ((start > 0 && ac -> wordChar[(unsigned char) text[start - 1]])
+				         || (pos + 1 < len && ac -> wordChar[(unsigned char) text[pos + 1]])) )
+				{
+					continue;
+					// Part of a longer word.
+				}
+				num = ac -> patternName[pattern];
+				if ( lastLine[num] == line && start < nextStart[num] )
+				{
+					continue;
+					// Overlaps the previous occurrence of the same name in this line.
+				}
+				lastLine[num] = line;
+				nextStart[num] = pos + 1;
+				add_event(found, units ? units -> unit : line, num);
+			}
+		}
+	}
+	if ( units && blank )
+	// A blank line ends a paragraph, and a sentence too.
+	{
+		units -> pending = true;
+	}
+}
+
+/*
+ * Function: add_event
+ * -------------------
+ * Description: append an occurrence to an event list, doubling it when full.
+ * Parameters: list: the event list;
+ *             line: the line number;
+ *             nameNo: the position of the name in the list.
+ * Return: N/A.
+ */
+void add_event(struct event_list *list, int line, int nameNo)
+{
+	if ( list -> num == list -> cap )
+	{
+		list -> cap = list -> cap ? list -> cap * 2 : INITIAL_EVENTS;
+		list -> events = realloc(list -> events, sizeof(struct event) * list -> cap);
+		if ( list -> events == NULL )
+		{
+			perror("list -> events");
+			exit(EXIT_FAILURE);
+		}
+	}
+	list -> events[list -> num].lineNo = line;
+	list -> events[list -> num].nameNo = nameNo;
+	list -> events[list -> num].occurNo = 0;
+	list -> num++;
+}
+
+/*
+ * Function: add_to_line_list
+ * --------------------------
+ * Description: append a line number to the list of a name.
+ *              The array doubles when it is full, so most calls do not allocate.
+ * Parameters: ch: the character whose name was found;
+ *             lineNo: line number.
+ * Return: N/A.
+ */
+void add_to_line_list(struct character *ch, int lineNo)
+{
+	if ( ch -> lineNum == ch -> lineCap )
+	{
+		ch -> lineCap = ch -> lineCap ? ch -> lineCap * 2 : INITIAL_LINES;
+		ch -> lineList = realloc(ch -> lineList, sizeof(int) * ch -> lineCap);
+		if ( ch -> lineList == NULL )
+		{
+			perror("ch -> lineList");
+			exit(EXIT_FAILURE);
+		}
+	}
+	ch -> lineList[ch -> lineNum++] = lineNo;
+}
+
+/*
+ * Function: analyse_and_output
+ * ----------------------------
+ * Description: analyse lists for each name and output the result into the designated file.
+ *              All occurrences are merged into one line-sorted event stream and a window
+ *              of opt -> window lines slides over it, so only pairs which actually
+ *              co-occur are ever looked at.
+ * Parameters: charList: a struct storing the content of the file.
+ *             nameNum: the number of names in the list;
+ *             opt: the output file, the window and the output style.
+ * Return: N/A.
+ */
+void analyse_and_output(struct character *charList, int nameNum, const struct options *opt)
+{
+	struct csv_writer writer;
+	open_writer(&writer, opt -> outputFile, OUTPUT_MODE, charList, nameNum, opt);
+	struct pair_output out = { opt -> style, &writer, charList, NULL, 0, 0, NULL, 0, 0,
+	                           opt -> graphFile || opt -> analyticsFile, new_decay(opt), opt -> stats };
+	sweep_line_lists(charList, nameNum, opt -> window, &out);
+	export_graph(&out, nameNum, opt);
+	flush_pairs(&out);
+	close_writer(&writer, opt -> outputFile);
+}
+
+/*
+ * Function: sweep_line_lists
+ * --------------------------
+ * Description: merge the line lists into one event stream and slide the window over it.
+ * Parameters: charList: a struct storing the names and their line lists;
+ *             nameNum: the number of names in the list;
+ *             window: the size of the window;
+ *             out: where the pairs go.
+ * Return: N/A.
+ */
+void sweep_line_lists(struct character *charList, int nameNum, int window, struct pair_output *out)
+{
+	size_t num, eventNum;
+	long long since = stats_clock(out -> stats);
+	struct event *events;
+	struct sweep sw = { NULL, 0, 0, 0, window };
+	eventNum = build_event_stream(charList, nameNum, 1, &events);
+	for ( num = 0; num < eventNum; num++ )
+	{
+		sweep_push(&sw, &events[num], out);
+	}
+	free(sw.window);
+	free(events);
+	stats_time(out -> stats, SWEEP_PHASE, since);
+}
+
+/*
+ * Function: stream_and_output
+ * ---------------------------
+ * Description: the streaming mode. The text is read line by line and every occurrence
+ *              goes straight to the sweep line, so no line lists are built and memory
+ *              does not grow with the length of the text. STREAM_ROWS and WEIGHTED_EDGES
+ *              give the same result as the normal mode (rows in the same line may come in
+ *              another order). parse_options() never leaves LEGACY_ROWS for this mode,
+ *              since it would have to hold every row until the end.
+ *              The text is read by one thread.
+ * Parameters: charList: a struct storing the names;
+ *             nameNum: the number of names in the list;
+ *             ac: the automaton built from the names;
+ *             opt: the input and output files, the window and the output style.
+ * Return: N/A.
+ */
+void stream_and_output(struct character *charList, int nameNum, const struct automaton *ac, const struct options *opt)
+{
+	FILE *in = open_stream(opt -> inputFile, INPUT_MODE);
+	if ( in == NULL )
+	{
+		perror(opt -> inputFile);
+		exit(EXIT_FAILURE);
+	}
+	struct csv_writer writer;
+	open_writer(&writer, opt -> outputFile, OUTPUT_MODE, charList, nameNum, opt);
+	int num, line = 0, *lastLine, *occurNum;
+	size_t pos, *nextStart, bufSize = 0;
+	ssize_t len;
+	long long since = stats_clock(opt -> stats);
+	char *userinput = NULL;
+	struct event_list found = { NULL, 0, 0 };
+	struct unit_state units = { 0, true, false };
+	struct sweep sw = { NULL, 0, 0, 0, opt -> window };
+	struct pair_output out = { opt -> style, &writer, charList, NULL, 0, 0, NULL, 0, 0,
+	                           opt -> graphFile || opt -> analyticsFile, new_decay(opt), opt -> stats };
+	lastLine = calloc(nameNum + 1, sizeof(int));
+	occurNum = calloc(nameNum + 1, sizeof(int));
+	nextStart = malloc(sizeof(size_t) * (nameNum + 1));
+	if ( lastLine == NULL || occurNum == NULL || nextStart == NULL )
+	{
+		perror("lastLine");
+		exit(EXIT_FAILURE);
+	}
+	while ( (len = getline(&userinput, &bufSize, in)) != -1 )
+	// getline() grows the buffer, so long lines are never split.
+	{
+		line++;
+		found.num = 0;
+		scan_line(ac, userinput, (size_t) len, line, lastLine, nextStart,
+		          ac -> unit == LINE_UNITS ? NULL : &units, &found);
+		if ( opt -> stats )
+		{
+			opt -> stats -> lines++;
+			opt -> stats -> bytes += len;
+			opt -> stats -> matches += found.num;
+		}
+		for ( pos = 0; pos < found.num; pos++ )
+		{
+			num = found.events[pos].nameNo;
+			found.events[pos].occurNo = occurNum[num]++;
+			sweep_push(&sw, &found.events[pos], &out);
+		}
+		if ( found.num && out.style == STREAM_ROWS )
+		// The rows of a line are passed on at once, as they were through stdio.
+		{
+			writer_flush(&writer);
+		}
+	}
+	if ( ferror(in) )
+	{
+		perror(opt -> inputFile);
+		// In this case, if an error occurs, the program will keep running.
+	}
+	stats_time(opt -> stats, SCAN_PHASE, since);
+	export_graph(&out, nameNum, opt);
+	flush_pairs(&out);
+	free(userinput);
+	free(found.events);
+	free(sw.window);
+	free(lastLine);
+	free(occurNum);
+	free(nextStart);
+	close_stream(in);
+	close_writer(&writer, opt -> outputFile);
+}
+
+/*
+ * Function: update_and_output
+ * ---------------------------
+ * Description: the incremental mode. The line lists, the edge counts and where the
+ *              last run stopped are kept in a state file, so only the text appended
+ *              since then is scanned. New occurrences are paired with each other and
+ *              with the old ones in the last window of lines, never old with old.
+ *              WEIGHTED_EDGES rewrites the edge list from the updated counts,
+ *              STREAM_ROWS appends the new rows to the output, and LEGACY_ROWS is
+ *              written again from the updated line lists (the text is not read again).
+ *              A last line without a newline is left for the next run.
+ *              The state holds a hash of the text it has read, so a replaced text is
+ *              refused. STREAM_ROWS closes the output before the state is saved and records
+ *              its size: rows left by a run which stopped in between are cut off by the next
+ *              run before it appends, unless the output is stdout, which cannot be cut.
+ * Parameters: charList: a struct storing the names;
+ *             nameNum: the number of names in the list;
+ *             ac: the automaton built from the names;
+ *             opt: the settings, including the state file.
+ * Return: N/A.
+ */
+void update_and_output(struct character *charList, int nameNum, const struct automaton *ac, const struct options *opt)
+{
+	struct csv_writer writer;
+	size_t num, len = 0, cut, eventNum, *oldNum;
+	const char *text;
+	_Bool resumed;
+	int from;
+	struct stat info;
+	struct state_header header;
+	struct scan_task *tasks;
+	struct event *events;
+	struct sweep sw = { NULL, 0, 0, 0, opt -> window };
+	struct pair_output out = { opt -> style == STREAM_ROWS ? STREAM_ROWS : WEIGHTED_EDGES,
+	                           NULL, charList, NULL, 0, 0, NULL, 0, 0, true, new_decay(opt), opt -> stats };
+	long long since = stats_clock(opt -> stats);
+	resumed = load_state(opt -> stateFile, charList, nameNum, opt, &header, &out);
+	text = map_input(opt -> inputFile, &len);
+	if ( text == NULL )
+	// Only an empty regular file cannot be mapped.
+	{
+		if ( stat(opt -> inputFile, &info) == -1 )
+		{
+			perror(opt -> inputFile);
+			exit(EXIT_FAILURE);
+		}
+		if ( !S_ISREG(info.st_mode) || info.st_size != 0 )
+		{
+			fprintf(stderr, "%s: the incremental mode needs a regular file\n", opt -> inputFile);
+			exit(EXIT_FAILURE);
+		}
+		len = 0;
+	}
+	if ( (long long) len < header.offset )
+	{
+		fprintf(stderr, "%s: shorter than when %s was saved\n", opt -> inputFile, opt -> stateFile);
+		exit(EXIT_FAILURE);
+	}
+	if ( text_hash(text, header.offset) != header.textHash )
+	{
+		fprintf(stderr, "%s: not the text %s was saved from (remove the state to start again)\n",
+		        opt -> inputFile, opt -> stateFile);
+		exit(EXIT_FAILURE);
+	}
+	for ( cut = len; cut > (size_t) header.offset && text[cut - 1] != '\n'; cut-- )
+	// Only complete lines are taken.
+	{
+		;
+	}
+	from = opt -> unit == LINE_UNITS ? header.lastLine + 1 : header.units.unit;
+	// New occurrences start from here; a sentence or paragraph may go on from the last run.
+	oldNum = malloc(sizeof(size_t) * (nameNum + 1));
+	if ( oldNum == NULL )
+	{
+		perror("oldNum");
+		exit(EXIT_FAILURE);
+	}
+	for ( num = 0; num < (size_t) nameNum; num++ )
+	{
+		oldNum[num] = charList[num].lineNum;
+	}
+	if ( cut > (size_t) header.offset )
+	{
+		tasks = new_tasks(ac, nameNum, opt -> threadNum, opt -> stats);
+		header.lastLine = scan_mapped(charList, tasks, opt -> threadNum, text + header.offset,
+		                              cut - header.offset, header.lastLine, &header.units);
+		header.offset = cut;
+		header.textHash = text_hash(text, cut);
+		free_tasks(tasks, opt -> threadNum);
+	}
+	if ( text )
+	{
+		munmap((void *) text, len);
+	}
+	if ( opt -> style == STREAM_ROWS )
+	{
+		if ( resumed && header.outputLen >= 0 && output_length(opt -> outputFile) > header.outputLen
+		     && truncate(opt -> outputFile, header.outputLen) == -1 )
+		// Drop the rows of a run which stopped before saving its state.
+		{
+			perror(opt -> outputFile);
+			exit(EXIT_FAILURE);
+		}
+		open_writer(&writer, opt -> outputFile, resumed ? APPEND_MODE : OUTPUT_MODE, charList, nameNum, opt);
+		out.writer = &writer;
+	}
+	stats_time(opt -> stats, SCAN_PHASE, since);
+	since = stats_clock(opt -> stats);
+	eventNum = build_event_stream(charList, nameNum, from - opt -> window + 1, &events);
+	for ( cut = 0; cut < eventNum; cut++ )
+	// Old events only fill the window. They all come first, even within the same unit.
+	{
+		if ( (size_t) events[cut].occurNo < oldNum[events[cut].nameNo] )
+		{
+			sweep_keep(&sw, &events[cut]);
+		}
+	}
+	for ( cut = 0; cut < eventNum; cut++ )
+	// New ones are paired as usual.
+	{
+		if ( (size_t) events[cut].occurNo >= oldNum[events[cut].nameNo] )
+		{
+			sweep_push(&sw, &events[cut], &out);
+		}
+	}
+	free(events);
+	free(oldNum);
+	free(sw.window);
+	stats_time(opt -> stats, SWEEP_PHASE, since);
+	since = stats_clock(opt -> stats);
+	if ( out.writer )
+	// The rows must all be out before the state says they are.
+	{
+		close_writer(&writer, opt -> outputFile);
+		out.writer = NULL;
+		header.outputLen = output_length(opt -> outputFile);
+	}
+	header.edgeNum = out.edgeNum;
+	save_state(opt -> stateFile, charList, &header, &out);
+	stats_time(opt -> stats, OUTPUT_PHASE, since);
+	if ( opt -> style != LEGACY_ROWS )
+	// LEGACY_ROWS does it when the rows are written again below.
+	{
+		export_graph(&out, nameNum, opt);
+	}
+	if ( opt -> style == WEIGHTED_EDGES )
+	{
+		open_writer(&writer, opt -> outputFile, OUTPUT_MODE, charList, nameNum, opt);
+		out.writer = &writer;
+		flush_pairs(&out);
+		close_writer(&writer, opt -> outputFile);
+	}
+	else
+	{
+		release_pairs(&out);
+	}
+	if ( opt -> style == LEGACY_ROWS )
+	{
+		analyse_and_output(charList, nameNum, opt);
+	}
+}
+
+/*
+ * Function: batch_and_output
+ * --------------------------
+ * Description: the batch mode. Every book in the manifest is scanned and written to its
+ *              own output file in the chosen style, using the automaton built once for all
+ *              of them. Books are handed out one at a time to opt -> threadNum threads, each
+ *              scanning its book on its own. The edges of every book are added to a merged
+ *              graph, written to opt -> outputFile as weighted edges (and to -g and -a).
+ * Parameters: charList: a struct storing the names;
+ *             nameNum: the number of names in the list;
+ *             ac: the automaton built from the names;
+ *             opt: the settings, including the manifest.
+ * Return: N/A.
+ */
+void batch_and_output(struct character *charList, int nameNum, const struct automaton *ac, const struct options *opt)
+{
+	struct csv_writer writer;
+	int task, threadNum;
+	size_t book;
+	pthread_t *threads;
+	struct batch job = { charList, nameNum, ac, opt, NULL, 0, 0,
+	                     { WEIGHTED_EDGES, NULL, charList, NULL, 0, 0, NULL, 0, 0, false, new_decay(opt), opt -> stats },
+	                     PTHREAD_MUTEX_INITIALIZER };
+	job.bookNum = read_manifest(opt -> manifest, &job.books);
+	threadNum = (size_t) opt -> threadNum < job.bookNum ? opt -> threadNum : (int) job.bookNum;
+	threads = malloc(sizeof(pthread_t) * (threadNum + 1));
+	if ( threads == NULL )
+	{
+		perror("threads");
+		exit(EXIT_FAILURE);
+	}
+	for ( task = 0; task < threadNum; task++ )
+	{
+		if ( pthread_create(&threads[task], NULL, batch_worker, &job) != 0 )
+		{
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for ( task = 0; task < threadNum; task++ )
+	{
+		pthread_join(threads[task], NULL);
+	}
+	pthread_mutex_destroy(&job.lock);
+	open_writer(&writer, opt -> outputFile, OUTPUT_MODE, charList, nameNum, opt);
+	job.merged.writer = &writer;
+	export_graph(&job.merged, nameNum, opt);
+	flush_pairs(&job.merged);
+	close_writer(&writer, opt -> outputFile);
+	for ( book = 0; book < job.bookNum; book++ )
+	{
+		free(job.books[book].inputFile);
+		// The output file shares the storage of the input file.
+	}
+	free(job.books);
+	free(threads);
+}
+
+/*
+ * Function: batch_worker
+ * ----------------------
+ * Description: the thread function of the batch mode. It takes the next book until none
+ *              is left, with its own copy of the characters so that the line lists of
+ *              different books never meet.
+ * Parameter: arg: the struct batch shared by the threads.
+ * Return: NULL.
+ */
+void *batch_worker(void *arg)
+{
+	struct batch *job = arg;
+	struct options opt = *job -> opt;
+	struct character *charList = malloc(sizeof(struct character) * (job -> nameNum + 1));
+	struct run_stats stats;
+	size_t book, slot;
+	int num;
+	struct csv_writer writer;
+	memset(&stats, 0, sizeof(struct run_stats));
+	if ( opt.stats )
+	{
+		opt.stats = &stats;
+	}
+	if ( charList == NULL )
+	{
+		perror("charList");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(charList, job -> charList, sizeof(struct character) * job -> nameNum);
+	opt.threadNum = 1;
+	// The books are the unit of parallelism.
+	while ( true )
+	{
+		pthread_mutex_lock(&job -> lock);
+		book = job -> nextBook++;
+		pthread_mutex_unlock(&job -> lock);
+		if ( book >= job -> bookNum )
+		{
+			break;
+		}
+		opt.inputFile = job -> books[book].inputFile;
+		get_line_numbers(charList, job -> nameNum, job -> ac, &opt);
+		open_writer(&writer, job -> books[book].outputFile, OUTPUT_MODE, charList, job -> nameNum, &opt);
+		struct pair_output out = { opt.style, &writer, charList, NULL, 0, 0, NULL, 0, 0, true, new_decay(&opt), opt.stats };
+		sweep_line_lists(charList, job -> nameNum, opt.window, &out);
+		pthread_mutex_lock(&job -> lock);
+		for ( slot = 0; slot < out.edgeCap; slot++ )
+		{
+			if ( out.edges[slot].used )
+			{
+				add_edge(&job -> merged, out.edges[slot].first, out.edges[slot].second, out.edges[slot].weight);
+			}
+		}
+		pthread_mutex_unlock(&job -> lock);
+		flush_pairs(&out);
+		close_writer(&writer, job -> books[book].outputFile);
+		for ( num = 0; num < job -> nameNum; num++ )
+		{
+			free(charList[num].lineList);
+		}
+	}
+	if ( opt.stats )
+	{
+		pthread_mutex_lock(&job -> lock);
+		stats_add(job -> opt -> stats, &stats);
+		pthread_mutex_unlock(&job -> lock);
+	}
+	free(charList);
+	return NULL;
+}
+
+/*
+ * Function: read_manifest
+ * -----------------------
+ * Description: read the list of books. Each line holds the text of a book and, optionally,
+ *              its output file, separated by white space; blank lines and lines starting
+ *              with '#' are skipped. The output file defaults to the text with its
+ *              extension replaced by BOOK_SUFFIX.
+ * Parameters: path: the manifest;
+ *             books: return the books.
+ * Return: the number of books.
+ */
+size_t read_manifest(const char *path, struct book **books)
+{
+	FILE *fp = open_stream(path, INPUT_MODE);
+	if ( fp == NULL )
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	size_t num = 0, cap = 0, bufSize = 0, len;
+	char *userinput = NULL, *input, *output, *strPtr;
+	*books = NULL;
+	while ( getline(&userinput, &bufSize, fp) != -1 )
+	{
+		for ( input = userinput; isspace((unsigned char) *input); input++ )
+		{
+			;
+		}
+		if ( *input == '\0' || *input == '#' )
+		{
+			continue;
+		}
+		for ( len = 0; input[len] && !isspace((unsigned char) input[len]); len++ )
+		{
+			;
+		}
+		for ( output = input + len; isspace((unsigned char) *output); output++ )
+		{
+			;
+		}
+		for ( strPtr = output; *strPtr && !isspace((unsigned char) *strPtr); strPtr++ )
+		{
+			;
+		}
+		*strPtr = '\0';
+		input[len] = '\0';
+		if ( num == cap )
+		{
+			cap = cap ? cap * 2 : INITIAL_LINES;
+			*books = realloc(*books, sizeof(struct book) * cap);
+			if ( *books == NULL )
+			{
+				perror("books");
+				exit(EXIT_FAILURE);
+			}
+		}
+		(*books)[num].inputFile = malloc(2 * len + strlen(output) + sizeof(BOOK_SUFFIX) + 1);
+		// Room for the input, then the output.
+		if ( (*books)[num].inputFile == NULL )
+		{
+			perror("books");
+			exit(EXIT_FAILURE);
+		}
+		strcpy((*books)[num].inputFile, input);
+		(*books)[num].outputFile = (*books)[num].inputFile + len + 1;
+		if ( *output )
+		{
+			strcpy((*books)[num].outputFile, output);
+		}
+		else
+		{
+			strcpy((*books)[num].outputFile, input);
+			strPtr = strrchr((*books)[num].outputFile, '.');
+			if ( strPtr && strchr(strPtr, '/') == NULL && strPtr != (*books)[num].outputFile
+			     && strPtr[-1] != '/' )
+			// Only an extension of the file name itself is replaced.
+			{
+				*strPtr = '\0';
+			}
+			strcat((*books)[num].outputFile, BOOK_SUFFIX);
+		}
+		num++;
+	}
+	if ( ferror(fp) )
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	free(userinput);
+	close_stream(fp);
+	return num;
+}
+
+/*
+ * Function: load_state
+ * --------------------
+ * Description: read the state file of an earlier run into the line lists and the
+ *              edge table. A missing file means starting from the beginning.
+ *              The state must come from the same name list, aliases, matching rules and window.
+ * Parameters: path: the state file;
+ *             charList: a struct storing the names;
+ *             nameNum: the number of names in the list;
+ *             opt: the window, unit, decay and matching options it must have been saved with;
+ *             header: return the header of the state;
+ *             out: where the edges go.
+ * Return: true if there was a state file.
+ */
+_Bool load_state(const char *path, struct character *charList, int nameNum, const struct options *opt,
+                 struct state_header *header, struct pair_output *out)
+{
+	int num, alias, aliasNum, status;
+	size_t len, edge;
+	struct edge item;
+	FILE *fp = fopen(path, "rb");
+	memset(header, 0, sizeof(struct state_header));
+	memcpy(header -> magic, STATE_MAGIC, sizeof(header -> magic));
+	header -> window = opt -> window;
+	header -> nameNum = nameNum;
+	header -> unit = opt -> unit;
+	header -> decay = opt -> decay;
+	header -> units.pending = true;
+	header -> foldCase = opt -> foldCase;
+	header -> wordBoundary = opt -> wordBoundary;
+	header -> textHash = text_hash(NULL, 0);
+	header -> outputLen = -1;
+	for ( num = 0; num < nameNum; num++ )
+	{
+		charList[num].lineList = NULL; // Initialise the list.
+		charList[num].lineNum = charList[num].lineCap = 0;
+	}
+	if ( fp == NULL )
+	{
+		return false;
+	}
+	if ( fread(header, sizeof(struct state_header), 1, fp) != 1
+	     || memcmp(header -> magic, STATE_MAGIC, sizeof(header -> magic)) != 0 )
+	{
+		fprintf(stderr, "%s: not a state file\n", path);
+		exit(EXIT_FAILURE);
+	}
+	if ( header -> window != opt -> window || header -> nameNum != nameNum
+	     || header -> unit != (int) opt -> unit || header -> decay != opt -> decay )
+	{
+		fprintf(stderr, "%s: saved with another name list or window\n", path);
+		exit(EXIT_FAILURE);
+	}
+	if ( header -> foldCase != opt -> foldCase || header -> wordBoundary != opt -> wordBoundary )
+	{
+		fprintf(stderr, "%s: saved with other matching options (-c, -b)\n", path);
+		exit(EXIT_FAILURE);
+	}
+	for ( num = 0; num < nameNum; num++ )
+	{
+		status = read_spelling(fp, charList[num].name);
+		if ( status == 0 )
+		{
+			if ( fread(&aliasNum, sizeof(int), 1, fp) != 1 )
+			{
+				status = -1;
+			}
+			else if ( aliasNum != charList[num].aliasNum )
+			{
+				status = 1;
+			}
+		}
+		for ( alias = 0; status == 0 && alias < charList[num].aliasNum; alias++ )
+		{
+			status = read_spelling(fp, charList[num].aliases[alias]);
+		}
+		if ( status == -1 )
+		{
+			fprintf(stderr, "%s: truncated\n", path);
+			exit(EXIT_FAILURE);
+		}
+		if ( status == 1 )
+		{
+			fprintf(stderr, "%s: saved with another name list or aliases\n", path);
+			exit(EXIT_FAILURE);
+		}
+	}
+	for ( num = 0; num < nameNum; num++ )
+	{
+		if ( fread(&len, sizeof(size_t), 1, fp) != 1 )
+		{
+			fprintf(stderr, "%s: truncated\n", path);
+			exit(EXIT_FAILURE);
+		}
+		charList[num].lineCap = len ? len : INITIAL_LINES;
+		charList[num].lineList = malloc(sizeof(int) * charList[num].lineCap);
+		if ( charList[num].lineList == NULL )
+		{
+			perror("charList[num].lineList");
+			exit(EXIT_FAILURE);
+		}
+		if ( fread(charList[num].lineList, sizeof(int), len, fp) != len )
+		{
+			fprintf(stderr, "%s: truncated\n", path);
+			exit(EXIT_FAILURE);
+		}
+		charList[num].lineNum = len;
+	}
+	for ( edge = 0; edge < header -> edgeNum; edge++ )
+	{
+		if ( fread(&item, sizeof(struct edge), 1, fp) != 1 )
+		{
+			fprintf(stderr, "%s: truncated\n", path);
+			exit(EXIT_FAILURE);
+		}
+		add_edge(out, item.first, item.second, item.weight);
+	}
 	fclose(fp);
+	return true;
+}
+
+/*
+ * Function: save_state
+ * --------------------
+ * Description: write the state for the next run. It goes to a temporary file first,
+ *              which then replaces the old state, so a failed run leaves the old one.
+ * Parameters: path: the state file;
+ *             charList: a struct storing the names and their line lists;
+ *             header: the header of the state;
+ *             out: the edge table.
+ * Return: N/A.
+ */
+void save_state(const char *path, struct character *charList, const struct state_header *header,
+                const struct pair_output *out)
+{
+	int num, alias;
+	size_t edge;
+	char *tmpPath = malloc(strlen(path) + sizeof(STATE_SUFFIX));
+	FILE *fp;
+	if ( tmpPath == NULL )
+	{
+		perror("tmpPath");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(tmpPath, path);
+	strcat(tmpPath, STATE_SUFFIX);
+	fp = fopen(tmpPath, "wb");
+	if ( fp == NULL )
+	{
+		perror(tmpPath);
+		exit(EXIT_FAILURE);
+	}
+	fwrite(header, sizeof(struct state_header), 1, fp);
+	for ( num = 0; num < header -> nameNum; num++ )
+	{
+		write_spelling(fp, charList[num].name);
+		fwrite(&charList[num].aliasNum, sizeof(int), 1, fp);
+		for ( alias = 0; alias < charList[num].aliasNum; alias++ )
+		{
+			write_spelling(fp, charList[num].aliases[alias]);
+		}
+	}
+	for ( num = 0; num < header -> nameNum; num++ )
+	{
+		fwrite(&charList[num].lineNum, sizeof(size_t), 1, fp);
+		fwrite(charList[num].lineList, sizeof(int), charList[num].lineNum, fp);
+	}
+	for ( edge = 0; edge < out -> edgeCap; edge++ )
+	{
+		if ( out -> edges[edge].used )
+		{
+			fwrite(&out -> edges[edge], sizeof(struct edge), 1, fp);
+		}
+	}
+	if ( ferror(fp) || fclose(fp) != 0 || rename(tmpPath, path) != 0 )
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	free(tmpPath);
+}
+
+/*
+ * Function: read_spelling
+ * -----------------------
+ * Description: read a name or an alias from a state file and compare it with the list.
+ * Parameters: fp: the state file;
+ *             spelling: the name or alias it should be.
+ * Return: 0 if it is the same, 1 if it is not, or -1 if the file ends first.
+ */
+int read_spelling(FILE *fp, const char *spelling)
+{
+	size_t len;
+	char *userinput;
+	int status;
+	if ( fread(&len, sizeof(size_t), 1, fp) != 1 )
+	{
+		return -1;
+	}
+	if ( len != strlen(spelling) )
+	// Names have no length limit, so only the one expected is read.
+	{
+		return 1;
+	}
+	userinput = malloc(len + 1);
+	if ( userinput == NULL )
+	{
+		perror("userinput");
+		exit(EXIT_FAILURE);
+	}
+	status = fread(userinput, 1, len, fp) != len ? -1 : memcmp(userinput, spelling, len) != 0;
+	free(userinput);
+	return status;
+}
+
+/*
+ * Function: write_spelling
+ * ------------------------
+ * Description: write a name or an alias to a state file: its length, then its characters.
+ * Parameters: fp: the state file;
+ *             spelling: the name or alias.
+ * Return: N/A.
+ */
+void write_spelling(FILE *fp, const char *spelling)
+{
+	size_t len = strlen(spelling);
+	fwrite(&len, sizeof(size_t), 1, fp);
+	fwrite(spelling, 1, len, fp);
+}
+
+/*
+ * Function: text_hash
+ * -------------------
+ * Description: identify the text read so far by its length and a 64-bit FNV-1a hash of
+ *              its first and last STATE_SAMPLE bytes, so that checking it costs the same
+ *              however long the text grows. A change which leaves both ends alone is not seen.
+ * Parameters: text: the text;
+ *             len: the number of bytes read so far.
+ * Return: the hash.
+ */
+uint64_t text_hash(const char *text, size_t len)
+{
+	uint64_t hash = 14695981039346656037u;
+	size_t pos, head = len < STATE_SAMPLE ? len : STATE_SAMPLE;
+	size_t tail = len - head < STATE_SAMPLE ? head : len - STATE_SAMPLE;
+	// The tail starts after the head when the two would overlap.
+	for ( pos = 0; pos < sizeof(size_t); pos++ )
+	{
+		hash = (hash ^ ((len >> (8 * pos)) & 0xff)) * 1099511628211u;
+	}
+	for ( pos = 0; pos < head; pos++ )
+	{
+		hash = (hash ^ (unsigned char) text[pos]) * 1099511628211u;
+	}
+	for ( pos = tail; pos < len; pos++ )
+	{
+		hash = (hash ^ (unsigned char) text[pos]) * 1099511628211u;
+	}
+	return hash;
+}
+
+/*
+ * Function: output_length
+ * -----------------------
+ * Description: the size of an output file.
+ * Parameter: path: the file, where STDIO_PATH stands for stdout.
+ * Return: the size, or -1 for stdout or anything which is not a regular file.
+ */
+long long output_length(const char *path)
+{
+	struct stat info;
+	if ( strcmp(path, STDIO_PATH) == 0 || stat(path, &info) == -1 || !S_ISREG(info.st_mode) )
+	{
+		return -1;
+	}
+	return info.st_size;
+}
+
+/*
+ * Function: build_event_stream
+ * ----------------------------
+ * Description: merge the line lists of all names into one array sorted by line number.
+ *              A counting sort over line numbers is used, so the cost is linear.
+ *              Events in the same line are ordered by name, then by occurrence.
+ * Parameters: charList: a struct storing the content of the file;
+ *             nameNum: the number of names in the list;
+ *             fromLine: occurrences before this line are left out;
+ *             events: return the newly allocated array of events.
+ * Return: eventNum: the number of events.
+ */
+size_t build_event_stream(struct character *charList, int nameNum, int fromLine, struct event **events)
+{
+	int num, line, maxLine = fromLine;
+	size_t occur, eventNum = 0, *count, *first;
+	first = malloc(sizeof(size_t) * (nameNum + 1));
+	if ( first == NULL )
+	{
+		perror("first");
+		exit(EXIT_FAILURE);
+	}
+	for ( num = 0; num < nameNum; num++ )
+	{
+		first[num] = charList[num].lineNum;
+		while ( first[num] > 0 && charList[num].lineList[first[num] - 1] >= fromLine )
+		// Lists are sorted, so the occurrences wanted are at the end.
+		{
+			first[num]--;
+		}
+		eventNum += charList[num].lineNum - first[num];
+		if ( charList[num].lineNum && charList[num].lineList[charList[num].lineNum - 1] > maxLine )
+		// The last line number of a list is its biggest.
+		{
+			maxLine = charList[num].lineList[charList[num].lineNum - 1];
+		}
+	}
+	count = calloc(maxLine - fromLine + 2, sizeof(size_t));
+	*events = malloc(sizeof(struct event) * (eventNum + 1));
+	if ( count == NULL || *events == NULL )
+	{
+		perror("events");
+		exit(EXIT_FAILURE);
+	}
+	for ( num = 0; num < nameNum; num++ )
+	{
+		for ( occur = first[num]; occur < charList[num].lineNum; occur++ )
+		{
+			count[charList[num].lineList[occur] - fromLine + 1]++;
+		}
+	}
+	for ( line = 1; line <= maxLine - fromLine + 1; line++ )
+	// count[line - fromLine] becomes the first slot of that line.
+	{
+		count[line] += count[line - 1];
+	}
+	for ( num = 0; num < nameNum; num++ )
+	{
+		for ( occur = first[num]; occur < charList[num].lineNum; occur++ )
+		{
+			line = charList[num].lineList[occur];
+			(*events)[count[line - fromLine]].lineNo = line;
+			(*events)[count[line - fromLine]].nameNo = num;
+			(*events)[count[line - fromLine]].occurNo = occur;
+			count[line - fromLine]++;
+		}
+	}
+	free(count);
+	free(first);
+	return eventNum;
+}
+
+/*
+ * Function: sweep_push
+ * --------------------
+ * Description: feed the next event of the stream to the sweep line.
+ *              Events which are sw -> width or more lines behind are dropped,
+ *              and every remaining event of another name forms a pair with the new one.
+ *              Events have to be pushed in line order.
+ * Parameters: sw: the state of the sweep line;
+ *             ev: the new event;
+ *             out: where the pairs go.
+ * Return: N/A.
+ */
+void sweep_push(struct sweep *sw, const struct event *ev, struct pair_output *out)
+{
+	size_t num;
+	struct event *earlier;
+	while ( sw -> count && ev -> lineNo - sw -> window[sw -> start].lineNo >= sw -> width )
+	{
+		sw -> start = (sw -> start + 1) % sw -> cap;
+		sw -> count--;
+	}
+	if ( out -> stats )
+	{
+		out -> stats -> comparisons += sw -> count;
+	}
+	for ( num = 0; num < sw -> count; num++ )
+	{
+		earlier = &sw -> window[(sw -> start + num) % sw -> cap];
+		if ( earlier -> nameNo != ev -> nameNo )
+		// A name never co-occurs with itself.
+		{
+			emit_pair(out, earlier, ev);
+		}
+	}
+	sweep_keep(sw, ev);
+}
+
+/*
+ * Function: sweep_keep
+ * --------------------
+ * Description: add an event to the window without pairing it, e.g. one which was
+ *              already paired in an earlier run.
+ * Parameters: sw: the state of the sweep line;
+ *             ev: the event.
+ * Return: N/A.
+ */
+void sweep_keep(struct sweep *sw, const struct event *ev)
+{
+	size_t num;
+	if ( sw -> count == sw -> cap )
+	// Grow the ring buffer and unwrap it at the same time.
+	{
+		size_t cap = sw -> cap ? sw -> cap * 2 : INITIAL_EVENTS;
+		struct event *window = malloc(sizeof(struct event) * cap);
+		if ( window == NULL )
+		{
+			perror("window");
+			exit(EXIT_FAILURE);
+		}
+		for ( num = 0; num < sw -> count; num++ )
+		{
+			window[num] = sw -> window[(sw -> start + num) % sw -> cap];
+		}
+		free(sw -> window);
+		sw -> window = window;
+		sw -> start = 0;
+		sw -> cap = cap;
+	}
+	sw -> window[(sw -> start + sw -> count) % sw -> cap] = *ev;
+	sw -> count++;
+}
+
+/*
+ * Function: emit_pair
+ * -------------------
+ * Description: output one co-occurrence. The name which comes first in the list
+ *              is always written first, as the old all-pairs loop did.
+ * Parameters: out: where the pairs go;
+ *             earlier: the occurrence found first;
+ *             later: the occurrence found later.
+ * Return: N/A.
+ */
+void emit_pair(struct pair_output *out, const struct event *earlier, const struct event *later)
+{
+	const struct event *first = earlier, *second = later;
+	double weight = out -> decay ? out -> decay[later -> lineNo - earlier -> lineNo] : 1.0;
+	if ( out -> stats )
+	{
+		out -> stats -> pairs++;
+		out -> stats -> rows += out -> style == STREAM_ROWS;
+	}
+	if ( first -> nameNo > second -> nameNo )
+	{
+		first = later;
+		second = earlier;
+	}
+	if ( out -> style == STREAM_ROWS )
+	{
+		writer_name(out -> writer, first -> nameNo);
+		writer_put(out -> writer, CSV_SEPARATOR, sizeof(CSV_SEPARATOR) - 1);
+		writer_name(out -> writer, second -> nameNo);
+		writer_put(out -> writer, "\n", 1);
+	}
+	if ( out -> countEdges && out -> style != WEIGHTED_EDGES )
+	{
+		add_edge(out, first -> nameNo, second -> nameNo, weight);
+	}
+	if ( out -> style == STREAM_ROWS )
+	{
+		return;
+	}
+	if ( out -> style == WEIGHTED_EDGES )
+	{
+		add_edge(out, first -> nameNo, second -> nameNo, weight);
+		return;
+	}
+	if ( out -> hitNum == out -> hitCap )
+	{
+		out -> hitCap = out -> hitCap ? out -> hitCap * 2 : INITIAL_EVENTS;
+		out -> hits = realloc(out -> hits, sizeof(struct hit) * out -> hitCap);
+		if ( out -> hits == NULL )
+		{
+			perror("hits");
+			exit(EXIT_FAILURE);
+		}
+	}
+	out -> hits[out -> hitNum].first = first -> nameNo;
+	out -> hits[out -> hitNum].second = second -> nameNo;
+	out -> hits[out -> hitNum].firstOccur = first -> occurNo;
+	out -> hits[out -> hitNum].secondOccur = second -> occurNo;
+	out -> hitNum++;
+}
+
+/*
+ * Function: compare_hits
+ * ----------------------
+ * Description: the order of rows written by the old all-pairs loop, used by qsort().
+ * Parameters: a, b: the hits to be compared.
+ * Return: negative, zero or positive as a is before, equal to or after b.
+ */
+int compare_hits(const void *a, const void *b)
+{
+	const struct hit *x = a, *y = b;
+	if ( x -> first != y -> first )
+	{
+		return x -> first < y -> first ? -1 : 1;
+	}
+	if ( x -> second != y -> second )
+	{
+		return x -> second < y -> second ? -1 : 1;
+	}
+	if ( x -> firstOccur != y -> firstOccur )
+	{
+		return x -> firstOccur < y -> firstOccur ? -1 : 1;
+	}
+	return (x -> secondOccur > y -> secondOccur) - (x -> secondOccur < y -> secondOccur);
+}
+
+/*
+ * Function: add_edge
+ * ------------------
+ * Description: add weight to the edge between two names, creating it if necessary.
+ *              The table is doubled when it becomes half full.
+ * Parameters: out: where the pairs go;
+ *             first, second: the names of the edge, first < second;
+ *             weight: the weight to be added.
+ * Return: N/A.
+ */
+void add_edge(struct pair_output *out, int first, int second, double weight)
+{
+	size_t num, slot;
+	if ( 2 * (out -> edgeNum + 1) > out -> edgeCap )
+	{
+		size_t cap = out -> edgeCap ? out -> edgeCap * 2 : INITIAL_EDGES;
+		struct edge *edges = calloc(cap, sizeof(struct edge));
+		if ( edges == NULL )
+		{
+			perror("edges");
+			exit(EXIT_FAILURE);
+		}
+		for ( num = 0; num < out -> edgeCap; num++ )
+		// Rehash every edge into the bigger table.
+		{
+			if ( out -> edges[num].used )
+			{
+				edges[edge_slot(edges, cap, out -> edges[num].first, out -> edges[num].second)] = out -> edges[num];
+			}
+		}
+		free(out -> edges);
+		out -> edges = edges;
+		out -> edgeCap = cap;
+	}
+	slot = edge_slot(out -> edges, out -> edgeCap, first, second);
+	if ( !out -> edges[slot].used )
+	{
+		out -> edges[slot].first = first;
+		out -> edges[slot].second = second;
+		out -> edges[slot].used = true;
+		out -> edgeNum++;
+	}
+	out -> edges[slot].weight += weight;
+}
+
+/*
+ * Function: edge_slot
+ * -------------------
+ * Description: find the slot of an edge with linear probing.
+ * Parameters: edges: the hash table;
+ *             edgeCap: the size of the table, a power of two;
+ *             first, second: the names of the edge.
+ * Return: the slot holding the edge, or the empty slot where it belongs.
+ */
+size_t edge_slot(const struct edge *edges, size_t edgeCap, int first, int second)
+{
+	size_t slot = ((size_t) first * 2654435761u ^ (size_t) second * 40503u) & (edgeCap - 1);
+	while ( edges[slot].used && (edges[slot].first != first || edges[slot].second != second) )
+	{
+		slot = (slot + 1) & (edgeCap - 1);
+	}
+	return slot;
+}
+
+/*
+ * Function: compare_edges
+ * -----------------------
+ * Description: order edges by the positions of their names in the list, used by qsort().
+ * Parameters: a, b: the edges to be compared.
+ * Return: negative, zero or positive as a is before, equal to or after b.
+ */
+int compare_edges(const void *a, const void *b)
+{
+	const struct edge *x = a, *y = b;
+	if ( x -> first != y -> first )
+	{
+		return x -> first < y -> first ? -1 : 1;
+	}
+	return (x -> second > y -> second) - (x -> second < y -> second);
+}
+
+/*
+ * Function: flush_pairs
+ * ---------------------
+ * Description: write out whatever the output style has been holding back.
+ * Parameter: out: where the pairs go.
+ * Return: N/A.
+ */
+void flush_pairs(struct pair_output *out)
+{
+	size_t num, slot;
+	char weight[DBL_MAX_10_EXP + 32];
+	// Room for any double in DECAYED_WEIGHT_FORMAT.
+	long long since = stats_clock(out -> stats);
+	if ( out -> style == LEGACY_ROWS )
+	{
+		if ( out -> stats )
+		{
+			out -> stats -> rows += out -> hitNum;
+		}
+		qsort(out -> hits, out -> hitNum, sizeof(struct hit), compare_hits);
+		for ( num = 0; num < out -> hitNum; num++ )
+		{
+			writer_name(out -> writer, out -> hits[num].first);
+			writer_put(out -> writer, CSV_SEPARATOR, sizeof(CSV_SEPARATOR) - 1);
+			writer_name(out -> writer, out -> hits[num].second);
+			writer_put(out -> writer, "\n", 1);
+		}
+	}
+	else if ( out -> style == WEIGHTED_EDGES )
+	{
+		for ( num = 0, slot = 0; num < out -> edgeCap; num++ )
+		// Pack the edges at the front of the table, then sort them.
+		{
+			if ( out -> edges[num].used )
+			{
+				out -> edges[slot++] = out -> edges[num];
+			}
+		}
+		qsort(out -> edges, out -> edgeNum, sizeof(struct edge), compare_edges);
+		if ( out -> stats )
+		{
+			out -> stats -> rows += out -> edgeNum;
+		}
+		for ( num = 0; num < out -> edgeNum; num++ )
+		{
+			writer_name(out -> writer, out -> edges[num].first);
+			writer_put(out -> writer, EDGE_SEPARATOR, sizeof(EDGE_SEPARATOR) - 1);
+			writer_name(out -> writer, out -> edges[num].second);
+			writer_put(out -> writer, EDGE_SEPARATOR, sizeof(EDGE_SEPARATOR) - 1);
+			if ( out -> decay )
+			{
+				writer_put(out -> writer, weight, snprintf(weight, sizeof(weight), DECAYED_WEIGHT_FORMAT,
+				                                           out -> edges[num].weight));
+			}
+			else
+			// A count, which "%.0f" would print as a whole number.
+			{
+				writer_number(out -> writer, (uint64_t) out -> edges[num].weight);
+			}
+			writer_put(out -> writer, "\n", 1);
+		}
+	}
+	stats_time(out -> stats, OUTPUT_PHASE, since);
+	release_pairs(out);
+}
+
+/*
+ * Function: release_pairs
+ * -----------------------
+ * Description: drop whatever the output style has been holding back without writing it.
+ * Parameter: out: where the pairs go.
+ * Return: N/A.
+ */
+void release_pairs(struct pair_output *out)
+{
+	free(out -> hits);
+	out -> hits = NULL;
+	out -> hitNum = out -> hitCap = 0;
+	free(out -> edges);
+	out -> edges = NULL;
+	out -> edgeNum = out -> edgeCap = 0;
+	free(out -> decay);
+	out -> decay = NULL;
+}
+
+/*
+ * Function: new_decay
+ * -------------------
+ * Description: tabulate the weight of a co-occurrence at every distance in the window.
+ * Parameter: opt: the window and the decay.
+ * Return: the table, or NULL if there is no decay.
+ */
+double *new_decay(const struct options *opt)
+{
+	int distance;
+	double *decay;
+	if ( opt -> decay == 1.0 )
+	{
+		return NULL;
+	}
+	decay = malloc(sizeof(double) * opt -> window);
+	if ( decay == NULL )
+	{
+		perror("decay");
+		exit(EXIT_FAILURE);
+	}
+	decay[0] = 1.0;
+	for ( distance = 1; distance < opt -> window; distance++ )
+	{
+		decay[distance] = decay[distance - 1] * opt -> decay;
+	}
+	return decay;
+}
+
+/*
+ * Function: export_graph
+ * ----------------------
+ * Description: turn the edges counted so far into a graph (see CharacterGraph.h),
+ *              then save it and write the analytics if they were asked for.
+ *              It must be called before flush_pairs(), which takes the table apart.
+ * Parameters: out: where the pairs go, with the edges counted;
+ *             nameNum: the number of names in the list;
+ *             opt: the graph and analytics files.
+ * Return: N/A.
+ */
+void export_graph(const struct pair_output *out, int nameNum, const struct options *opt)
+{
+	size_t num, edgeNum = 0;
+	int nameNo;
+	struct character_graph g;
+	struct graph_edge *edges;
+	const char **names;
+	long long since;
+	if ( opt -> graphFile == NULL && opt -> analyticsFile == NULL )
+	{
+		return;
+	}
+	since = stats_clock(opt -> stats);
+	edges = malloc(sizeof(struct graph_edge) * (out -> edgeNum + 1));
+	names = malloc(sizeof(char *) * (nameNum + 1));
+	if ( edges == NULL || names == NULL )
+	{
+		perror("graph");
+		exit(EXIT_FAILURE);
+	}
+	for ( nameNo = 0; nameNo < nameNum; nameNo++ )
+	{
+		names[nameNo] = out -> charList[nameNo].name;
+	}
+	for ( num = 0; num < out -> edgeCap; num++ )
+	{
+		if ( out -> edges[num].used )
+		{
+			edges[edgeNum].first = out -> edges[num].first;
+			edges[edgeNum].second = out -> edges[num].second;
+			edges[edgeNum].weight = out -> edges[num].weight;
+			edgeNum++;
+		}
+	}
+	if ( graph_build(&g, nameNum, names, edgeNum, edges) == -1 )
+	{
+		perror("graph");
+		exit(EXIT_FAILURE);
+	}
+	free(edges);
+	free(names);
+	if ( opt -> graphFile && graph_write(&g, opt -> graphFile) == -1 )
+	{
+		perror(opt -> graphFile);
+		exit(EXIT_FAILURE);
+	}
+	if ( opt -> analyticsFile )
+	{
+		write_analytics(&g, opt);
+	}
+	graph_close(&g);
+	stats_time(opt -> stats, GRAPH_PHASE, since);
+}
+
+/*
+ * Function: write_analytics
+ * -------------------------
+ * Description: compute the weighted degree, PageRank and betweenness of every character
+ *              on opt -> threadNum threads and write them, highest PageRank first.
+ * Parameters: g: the graph;
+ *             opt: the analytics file and the number of threads.
+ * Return: N/A.
+ */
+void write_analytics(const struct character_graph *g, const struct options *opt)
+{
+	FILE *fp;
+	uint32_t node, pos;
+	struct ranking *order = malloc(sizeof(struct ranking) * (g -> nodeNum + 1));
+	double *values = malloc(sizeof(double) * (3 * g -> nodeNum + 1)), *degree, *rank, *between;
+	if ( values == NULL || order == NULL )
+	{
+		perror("analytics");
+		exit(EXIT_FAILURE);
+	}
+	degree = values;
+	rank = values + g -> nodeNum;
+	between = values + 2 * g -> nodeNum;
+	if ( graph_weighted_degree(g, opt -> threadNum, degree) == -1
+	     || graph_pagerank(g, opt -> threadNum, PAGERANK_DAMPING, PAGERANK_ITERATIONS,
+	                       PAGERANK_TOLERANCE, rank) == -1
+	     || graph_betweenness(g, opt -> threadNum, BETWEENNESS_SAMPLES, between) == -1 )
+	{
+		perror("analytics");
+		exit(EXIT_FAILURE);
+	}
+	for ( node = 0; node < g -> nodeNum; node++ )
+	{
+		order[node].rank = rank[node];
+		order[node].id = node;
+	}
+	qsort(order, g -> nodeNum, sizeof(struct ranking), compare_rankings);
+	fp = open_stream(opt -> analyticsFile, OUTPUT_MODE);
+	if ( fp == NULL )
+	{
+		perror(opt -> analyticsFile);
+		exit(EXIT_FAILURE);
+	}
+	fputs(ANALYTICS_HEADER, fp);
+	for ( pos = 0; pos < g -> nodeNum; pos++ )
+	{
+		node = order[pos].id;
+		fprintf(fp, ANALYTICS_FORMAT, graph_name(g, node), degree[node], rank[node], between[node]);
+	}
+	close_stream(fp);
+	free(values);
+	free(order);
+}
+
+/*
+ * Function: query_graph
+ * ---------------------
+ * Description: map the graph file of -g and write what -q asks for: the neighbours of one
+ *              name, heaviest first, or the weight between two names (0 if they never meet).
+ * Parameter: opt: the graph file, the query and the output file.
+ * Return: N/A.
+ */
+void query_graph(const struct options *opt)
+{
+	struct character_graph g;
+	FILE *fp;
+	const char *comma = strchr(opt -> query, QUERY_SEPARATOR);
+	char *first = malloc(strlen(opt -> query) + 1);
+	long node, other = -1L;
+	size_t num, degree;
+	const uint32_t *rowIds;
+	const double *rowWeights;
+	uint32_t *ids;
+	double *weights;
+	if ( first == NULL )
+	{
+		perror("query");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(first, opt -> query);
+	if ( comma )
+	{
+		first[comma - opt -> query] = '\0';
+	}
+	if ( graph_open(&g, opt -> graphFile) == -1 )
+	{
+		perror(opt -> graphFile);
+		exit(EXIT_FAILURE);
+	}
+	if ( (node = graph_find(&g, first)) == -1L || (comma && (other = graph_find(&g, comma + 1)) == -1L) )
+	{
+		fprintf(stderr, "%s: no such name in %s\n", other == -1L && node != -1L ? comma + 1 : first,
+		        opt -> graphFile);
+		exit(EXIT_FAILURE);
+	}
+	fp = open_stream(opt -> outputFile, OUTPUT_MODE);
+	if ( fp == NULL )
+	{
+		perror(opt -> outputFile);
+		exit(EXIT_FAILURE);
+	}
+	if ( comma )
+	{
+		print_edge(fp, graph_name(&g, node), graph_name(&g, other), graph_weight(&g, node, other), opt);
+	}
+	else
+	{
+		degree = graph_neighbours(&g, node, &rowIds, &rowWeights);
+		ids = malloc(sizeof(uint32_t) * (degree + 1));
+		weights = malloc(sizeof(double) * (degree + 1));
+		if ( ids == NULL || weights == NULL )
+		{
+			perror("query");
+			exit(EXIT_FAILURE);
+		}
+		degree = graph_top_k(&g, node, degree, ids, weights);
+		for ( num = 0; num < degree; num++ )
+		{
+			print_edge(fp, graph_name(&g, node), graph_name(&g, ids[num]), weights[num], opt);
+		}
+		free(ids);
+		free(weights);
+	}
+	close_stream(fp);
+	graph_close(&g);
+	free(first);
+}
+
+/*
+ * Function: print_edge
+ * --------------------
+ * Description: write an edge as a "name1,name2,weight" row, the weight as -s weighted writes it.
+ * Parameters: fp: the output file;
+ *             first, second: the names;
+ *             weight: the weight;
+ *             opt: the decay, which decides whether the weight is a count.
+ * Return: N/A.
+ */
+void print_edge(FILE *fp, const char *first, const char *second, double weight, const struct options *opt)
+{
+	fprintf(fp, "%s" EDGE_SEPARATOR "%s" EDGE_SEPARATOR, first, second);
+	fprintf(fp, opt -> decay == 1.0 ? "%.0f\n" : DECAYED_WEIGHT_FORMAT "\n", weight);
+}
+
+/*
+ * Function: compare_rankings
+ * --------------------------
+ * Description: order characters by PageRank, highest first, then by their positions
+ *              in the list, used by qsort().
+ * Parameters: a, b: the rankings to be compared.
+ * Return: negative, zero or positive as a is before, equal to or after b.
+ */
+int compare_rankings(const void *a, const void *b)
+{
+	const struct ranking *x = a, *y = b;
+	if ( x -> rank != y -> rank )
+	{
+		return x -> rank > y -> rank ? -1 : 1;
+	}
+	return (x -> id > y -> id) - (x -> id < y -> id);
+}
+
+/*
+ * Function: stats_clock
+ * ---------------------
+ * Description: read the monotonic clock, but only when -p is given.
+ * Parameter: stats: the counters for -p, or NULL.
+ * Return: the time in nanoseconds, or 0 if stats is NULL.
+ */
+long long stats_clock(const struct run_stats *stats)
+{
+	struct timespec now;
+	if ( stats == NULL )
+	{
+		return 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*
+ * Function: stats_time
+ * --------------------
+ * Description: add the time since a reading of stats_clock() to a phase.
+ * Parameters: stats: the counters for -p, or NULL;
+ *             phase: the phase being timed;
+ *             since: what stats_clock() gave at the start of it.
+ * Return: N/A.
+ */
+void stats_time(struct run_stats *stats, enum statsPhase phase, long long since)
+{
+	if ( stats )
+	{
+		stats -> ns[phase] += stats_clock(stats) - since;
+	}
+}
+
+/*
+ * Function: stats_add
+ * -------------------
+ * Description: add the counters and timers of one thread to the total.
+ * Parameters: total: where they are added up;
+ *             part: those of one thread.
+ * Return: N/A.
+ */
+void stats_add(struct run_stats *total, const struct run_stats *part)
+{
+	int phase;
+	total -> lines += part -> lines;
+	total -> bytes += part -> bytes;
+	total -> matches += part -> matches;
+	total -> lineAllocs += part -> lineAllocs;
+	total -> comparisons += part -> comparisons;
+	total -> pairs += part -> pairs;
+	total -> rows += part -> rows;
+	for ( phase = 0; phase < PHASE_NUM; phase++ )
+	{
+		total -> ns[phase] += part -> ns[phase];
+	}
+}
+
+/*
+ * Function: print_stats
+ * ---------------------
+ * Description: write the counters and timers as one JSON object.
+ * Parameters: stats: the counters;
+ *             fp: where they go.
+ * Return: N/A.
+ */
+void print_stats(const struct run_stats *stats, FILE *fp)
+{
+	static const char *phaseNames[PHASE_NUM] = PHASE_NAMES;
+	int phase;
+	fprintf(fp, "{\"lines\": %llu, \"bytes\": %llu, \"matches\": %llu, \"line_list_allocations\": %llu, "
+	            "\"comparisons\": %llu, \"pairs\": %llu, \"rows\": %llu, \"ns\": {",
+	        stats -> lines, stats -> bytes, stats -> matches, stats -> lineAllocs,
+	        stats -> comparisons, stats -> pairs, stats -> rows);
+	for ( phase = 0; phase < PHASE_NUM; phase++ )
+	{
+		fprintf(fp, "%s\"%s\": %lld", phase ? ", " : "", phaseNames[phase], stats -> ns[phase]);
+	}
+	fputs("}}\n", fp);
 }
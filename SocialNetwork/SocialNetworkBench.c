@@ -0,0 +1,417 @@
+/*
+ *  Created on: Oct 15, 2026
+ *     Version: v1.0-1015
+ * Description: Benchmark SocialNetwork.c phase by phase. Synthetic corpora of growing
+ *              size are made by repeating a seed text, and cast lists of 20, 64,
+ *              1000 and 10000 names are made from the shipped lists plus capitalised
+ *              words of the seed. For every corpus and cast, read_names, build_automaton,
+ *              get_line_numbers and analyse_and_output are timed separately, with the
+ *              number of allocations and the peak resident set size after each phase.
+ *       Build: gcc -std=c99 -O2 -pthread -o SocialNetworkBench SocialNetworkBench.c -lm
+ *              CharacterGraph.c and CsvWriter.c are included below, so they are not linked.
+ *       Usage: SocialNetworkBench [-i seed] [-r repeats] [-t threads] [-s legacy|stream|weighted]
+ *              The corpus is the seed repeated 1, 2, 4, ... up to repeats times.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+// Define it in order to use POSIX threads, mkstemp() and clock_gettime().
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+// Every allocation made by SocialNetwork.c, CsvWriter.c and CharacterGraph.c goes through these counters.
+void *counted_malloc(size_t size);
+void *counted_calloc(size_t num, size_t size);
+void *counted_realloc(void *ptr, size_t size);
+#define malloc(size) counted_malloc(size)
+#define calloc(num, size) counted_calloc(num, size)
+#define realloc(ptr, size) counted_realloc(ptr, size)
+
+#define SOCIAL_NETWORK_LIBRARY
+#include "SocialNetwork.c"
+#include "CsvWriter.c"
+#include "CharacterGraph.c"
+
+#undef malloc
+#undef calloc
+#undef realloc
+
+#define BENCH_OPTIONS "i:r:t:s:h"
+#define DEFAULT_REPEATS 8
+#define SMALL_CAST "./InputFiles/Les-Mis-Names-20.txt"
+#define MEDIUM_CAST "./InputFiles/Les-Mis-Names.txt"
+#define TEMP_TEMPLATE "/tmp/SocialNetworkBench-XXXXXX"
+#define MIN_WORD_LEN 3
+#define CAST_NUM 4
+
+unsigned long allocNum = 0;
+pthread_mutex_t allocLock = PTHREAD_MUTEX_INITIALIZER;
+// Scanning threads allocate too.
+
+// The figures of one phase.
+struct phase
+{
+	double start;
+	unsigned long allocStart;
+};
+
+// Function declarations.
+void make_corpus(const char *seed, size_t seedLen, int repeats, char *path);
+void make_cast(const char *seed, size_t seedLen, int nameNum, char *path);
+int compare_words(const void *a, const void *b);
+void run_phases(const char *corpus, size_t corpusLen, const char *cast, int nameNum, const struct options *base);
+void begin_phase(struct phase *ph);
+void end_phase(const struct phase *ph, size_t corpusLen, int nameNum, const char *name, size_t bytes);
+double now(void);
+
+int main(int argc, char *argv[])
+{
+	int c, repeats, maxRepeats = DEFAULT_REPEATS, cast;
+	int castSize[CAST_NUM] = { 20, 64, 1000, 10000 };
+	char corpus[sizeof(TEMP_TEMPLATE)], castPath[CAST_NUM][sizeof(TEMP_TEMPLATE)];
+	const char *seedPath = INPUT_FILE, *seed;
+	size_t seedLen;
+	struct options opt;
+	char *defaults[] = { argv[0], NULL };
+	optind = 1;
+	parse_options(1, defaults, &opt);
+	opt.outputFile = "/dev/null";
+	opt.style = WEIGHTED_EDGES;
+	// Legacy rows of a 10000-name cast do not fit in memory for long.
+	while ( (c = getopt(argc, argv, BENCH_OPTIONS)) != -1 )
+	{
+		switch ( c )
+		{
+			case 'i':
+				seedPath = optarg;
+				break;
+			case 'r':
+				maxRepeats = atoi(optarg);
+				break;
+			case 't':
+				opt.threadNum = atoi(optarg);
+				break;
+			case 's':
+				opt.style = strcmp(optarg, "legacy") == 0 ? LEGACY_ROWS
+				          : strcmp(optarg, "stream") == 0 ? STREAM_ROWS : WEIGHTED_EDGES;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-i seed] [-r repeats] [-t threads] "
+				                "[-s legacy|stream|weighted]\n", argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+	if ( maxRepeats < 1 || opt.threadNum < 1 )
+	{
+		fprintf(stderr, "%s: repeats and threads must be positive\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	seed = map_input(seedPath, &seedLen);
+	if ( seed == NULL )
+	{
+		fprintf(stderr, "%s: cannot map the seed text\n", seedPath);
+		exit(EXIT_FAILURE);
+	}
+	for ( cast = 0; cast < CAST_NUM; cast++ )
+	{
+		make_cast(seed, seedLen, castSize[cast], castPath[cast]);
+	}
+	printf("%12s %6s  %-18s %10s %10s %10s %10s\n",
+	       "bytes", "names", "phase", "ms", "MB/s", "allocs", "peak KB");
+	for ( repeats = 1; repeats <= maxRepeats; repeats *= 2 )
+	{
+		make_corpus(seed, seedLen, repeats, corpus);
+		for ( cast = 0; cast < CAST_NUM; cast++ )
+		{
+			run_phases(corpus, seedLen * repeats, castPath[cast], castSize[cast], &opt);
+		}
+		unlink(corpus);
+	}
+	for ( cast = 0; cast < CAST_NUM; cast++ )
+	{
+		unlink(castPath[cast]);
+	}
+	munmap((void *) seed, seedLen);
+	return 0;
+}
+
+/*
+ * Function: make_corpus
+ * ---------------------
+ * Description: write the seed text several times into a temporary file.
+ * Parameters: seed: the seed text;
+ *             seedLen: the length of the seed;
+ *             repeats: how many times it is written;
+ *             path: return the name of the file (sizeof(TEMP_TEMPLATE) bytes).
+ * Return: N/A.
+ */
+void make_corpus(const char *seed, size_t seedLen, int repeats, char *path)
+{
+	int num, fd;
+	FILE *fp;
+	strcpy(path, TEMP_TEMPLATE);
+	fd = mkstemp(path);
+	if ( fd == -1 || (fp = fdopen(fd, "w")) == NULL )
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	for ( num = 0; num < repeats; num++ )
+	{
+		fwrite(seed, 1, seedLen, fp);
+	}
+	if ( ferror(fp) || fclose(fp) != 0 )
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Function: make_cast
+ * -------------------
+ * Description: write a cast list of the given size into a temporary file.
+ *              The shipped lists are used as they are for 20 and 64 names;
+ *              bigger casts add distinct capitalised words of the seed, so that
+ *              the names really occur, and then made-up names if still short.
+ * Parameters: seed: the seed text;
+ *             seedLen: the length of the seed;
+ *             nameNum: the size of the cast;
+ *             path: return the name of the file (sizeof(TEMP_TEMPLATE) bytes).
+ * Return: N/A.
+ */
+void make_cast(const char *seed, size_t seedLen, int nameNum, char *path)
+{
+	int fd, num = 0;
+	size_t pos, start, wordNum = 0, wordCap = 0, word;
+	char userinput[BUFFER_SIZE], **words = NULL;
+	FILE *fp, *in = fopen(nameNum <= 20 ? SMALL_CAST : MEDIUM_CAST, INPUT_MODE);
+	strcpy(path, TEMP_TEMPLATE);
+	fd = mkstemp(path);
+	if ( in == NULL || fd == -1 || (fp = fdopen(fd, "w")) == NULL )
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	while ( num < nameNum && fscanf(in, "%255s", userinput) == NFIELD )
+	{
+		fprintf(fp, "%s\n", userinput);
+		num++;
+	}
+	fclose(in);
+	for ( pos = 0; num < nameNum && pos < seedLen; )
+	// Collect capitalised words such as "Marius" or "Paris".
+	{
+		while ( pos < seedLen && !isalpha((unsigned char) seed[pos]) )
+		{
+			pos++;
+		}
+		start = pos;
+		while ( pos < seedLen && isalpha((unsigned char) seed[pos]) )
+		{
+			pos++;
+		}
+		if ( pos - start >= MIN_WORD_LEN && pos - start < BUFFER_SIZE && isupper((unsigned char) seed[start]) )
+		{
+			if ( wordNum == wordCap )
+			{
+				wordCap = wordCap ? wordCap * 2 : INITIAL_EVENTS;
+				words = realloc(words, sizeof(char *) * wordCap);
+				if ( words == NULL )
+				{
+					perror("words");
+					exit(EXIT_FAILURE);
+				}
+			}
+			words[wordNum] = strndup(seed + start, pos - start);
+			if ( words[wordNum] == NULL )
+			{
+				perror("words[wordNum]");
+				exit(EXIT_FAILURE);
+			}
+			wordNum++;
+		}
+	}
+	qsort(words, wordNum, sizeof(char *), compare_words);
+	for ( word = 0; word < wordNum; word++ )
+	{
+		if ( num < nameNum && (word == 0 || strcmp(words[word], words[word - 1]) != 0) )
+		{
+			fprintf(fp, "%s\n", words[word]);
+			num++;
+		}
+	}
+	for ( word = 0; word < wordNum; word++ )
+	{
+		free(words[word]);
+	}
+	free(words);
+	while ( num < nameNum )
+	// Names which never occur still cost automaton states.
+	{
+		fprintf(fp, "Name%05d\n", num);
+		num++;
+	}
+	if ( ferror(fp) || fclose(fp) != 0 )
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Function: compare_words
+ * -----------------------
+ * Description: compare two strings through pointers, used by qsort().
+ * Parameters: a, b: the strings to be compared.
+ * Return: negative, zero or positive as in strcmp().
+ */
+int compare_words(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/*
+ * Function: run_phases
+ * --------------------
+ * Description: run the four phases of SocialNetwork.c over one corpus and one cast
+ *              and print a row per phase.
+ * Parameters: corpus: the text file;
+ *             corpusLen: the length of the text;
+ *             cast: the name list;
+ *             nameNum: the size of the cast;
+ *             base: the settings shared by every run.
+ * Return: N/A.
+ */
+void run_phases(const char *corpus, size_t corpusLen, const char *cast, int nameNum, const struct options *base)
+{
+	struct options opt = *base;
+	struct name_table names;
+	struct character *charList;
+	struct automaton ac;
+	struct phase ph;
+	struct stat info;
+	size_t num;
+	opt.inputFile = corpus;
+	opt.nameList = cast;
+	stat(cast, &info);
+	begin_phase(&ph);
+	num = read_names(&names, opt.nameList);
+	charList = names.chars;
+	end_phase(&ph, corpusLen, nameNum, "read_names", (size_t) info.st_size);
+	begin_phase(&ph);
+	build_automaton(&ac, charList, num, &opt);
+	end_phase(&ph, corpusLen, nameNum, "build_automaton", (size_t) info.st_size);
+	begin_phase(&ph);
+	get_line_numbers(charList, num, &ac, &opt);
+	end_phase(&ph, corpusLen, nameNum, "get_line_numbers", corpusLen);
+	free_automaton(&ac);
+	begin_phase(&ph);
+	analyse_and_output(charList, num, &opt);
+	end_phase(&ph, corpusLen, nameNum, "analyse_and_output", corpusLen);
+	free_names(&names);
+}
+
+/*
+ * Function: begin_phase
+ * ---------------------
+ * Description: remember the clock and the allocation counter.
+ * Parameter: ph: the phase.
+ * Return: N/A.
+ */
+void begin_phase(struct phase *ph)
+{
+	ph -> allocStart = allocNum;
+	ph -> start = now();
+}
+
+/*
+ * Function: end_phase
+ * -------------------
+ * Description: print the wall time, throughput, allocations and peak RSS of a phase.
+ *              The peak RSS is that of the whole process so far.
+ * Parameters: ph: the phase;
+ *             corpusLen: the length of the text;
+ *             nameNum: the size of the cast;
+ *             name: the name of the phase;
+ *             bytes: the bytes the phase works on, for the throughput.
+ * Return: N/A.
+ */
+void end_phase(const struct phase *ph, size_t corpusLen, int nameNum, const char *name, size_t bytes)
+{
+	double elapsed = now() - ph -> start;
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf("%12lu %6d  %-18s %10.2f %10.1f %10lu %10ld\n", (unsigned long) corpusLen, nameNum, name,
+	       elapsed * 1000.0, elapsed > 0.0 ? bytes / elapsed / 1e6 : 0.0,
+	       allocNum - ph -> allocStart, usage.ru_maxrss);
+	fflush(stdout);
+}
+
+/*
+ * Function: now
+ * -------------
+ * Description: read the monotonic clock.
+ * Parameter: N/A.
+ * Return: the time in seconds.
+ */
+double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Function: counted_malloc
+ * ------------------------
+ * Description: malloc() which counts the call.
+ * Parameter: size: as in malloc().
+ * Return: as in malloc().
+ */
+void *counted_malloc(size_t size)
+{
+	pthread_mutex_lock(&allocLock);
+	allocNum++;
+	pthread_mutex_unlock(&allocLock);
+	return malloc(size);
+}
+
+/*
+ * Function: counted_calloc
+ * ------------------------
+ * Description: calloc() which counts the call.
+ * Parameters: num, size: as in calloc().
+ * Return: as in calloc().
+ */
+void *counted_calloc(size_t num, size_t size)
+{
+	pthread_mutex_lock(&allocLock);
+	allocNum++;
+	pthread_mutex_unlock(&allocLock);
+	return calloc(num, size);
+}
+
+/*
+ * Function: counted_realloc
+ * -------------------------
+ * Description: realloc() which counts the call.
+ * Parameters: ptr, size: as in realloc().
+ * Return: as in realloc().
+ */
+void *counted_realloc(void *ptr, size_t size)
+{
+	pthread_mutex_lock(&allocLock);
+	allocNum++;
+	pthread_mutex_unlock(&allocLock);
+	return realloc(ptr, size);
+}